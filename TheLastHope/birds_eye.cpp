@@ -0,0 +1,55 @@
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+#include "birds_eye.hpp"
+
+using namespace cv;
+using namespace std;
+
+BirdsEyeView::BirdsEyeView(Rect2f area, double pixelsPerUnit, double maxRotationDeg, double maxShift)
+	: area(area), pixelsPerUnit(pixelsPerUnit > 0 ? pixelsPerUnit : 1),
+	  maxRotation(maxRotationDeg * CV_PI / 180), maxShift(maxShift)
+{
+	outputSize = Size(std::max(1, cvRound(area.width * this->pixelsPerUnit)),
+		std::max(1, cvRound(area.height * this->pixelsPerUnit)));
+}
+
+Point2f BirdsEyeView::toBoard(Point2f pixel) const
+{
+	return Point2f(area.x + (float)(pixel.x / pixelsPerUnit), area.y + (float)(pixel.y / pixelsPerUnit));
+}
+
+bool BirdsEyeView::update(const Matx33d& cameraMatrix, const Mat& distCoeffs, const Vec3d& rvec, const Vec3d& tvec)
+{
+	if (ready())
+	{
+		// rotation between the two poses, and how far the board origin moved
+		Matx33d R0, R1;
+		Rodrigues(mapR, R0);
+		Rodrigues(rvec, R1);
+		Vec3d delta;
+		Rodrigues(R1 * R0.t(), delta);
+		if (norm(delta) <= maxRotation && norm(tvec - mapT) <= maxShift)
+			return false;
+	}
+
+	Mat plane(outputSize.area(), 1, CV_32FC3);
+	Point3f* p = plane.ptr<Point3f>();
+	for (int y = 0; y < outputSize.height; y++)
+		for (int x = 0; x < outputSize.width; x++)
+		{
+			const Point2f b = toBoard(Point2f((float)x, (float)y));
+			*p++ = Point3f(b.x, b.y, 0);
+		}
+
+	Mat projected;
+	projectPoints(plane, rvec, tvec, cameraMatrix, distCoeffs, projected);
+	convertMaps(projected.reshape(2, outputSize.height), noArray(), map1, map2, CV_16SC2);
+	mapR = rvec;
+	mapT = tvec;
+	return true;
+}
+
+void BirdsEyeView::render(const Mat& view, Mat& rectified) const
+{
+	remap(view, rectified, map1, map2, INTER_LINEAR, BORDER_CONSTANT);
+}
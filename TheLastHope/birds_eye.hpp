@@ -0,0 +1,35 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Metric top-down view of the board plane. Every output pixel is a point of the z = 0 plane
+// (area, in board units, at pixelsPerUnit pixels per unit) projected with the full camera model,
+// distortion included, so the raw frame is rectified by a single remap. The maps are rebuilt
+// only when the pose moved by more than maxRotationDeg / maxShift (board units) since the last
+// build.
+class BirdsEyeView
+{
+public:
+	BirdsEyeView(Rect2f area, double pixelsPerUnit, double maxRotationDeg = 0.5, double maxShift = 1);
+
+	// true when the maps were rebuilt for this pose
+	bool update(const Matx33d& cameraMatrix, const Mat& distCoeffs, const Vec3d& rvec, const Vec3d& tvec);
+	bool ready() const { return !map1.empty(); }
+	void render(const Mat& view, Mat& rectified) const;
+
+	Size size() const { return outputSize; }
+	// board plane point of an output pixel, in board units
+	Point2f toBoard(Point2f pixel) const;
+
+private:
+	Rect2f area;
+	double pixelsPerUnit;
+	double maxRotation;
+	double maxShift;
+	Size outputSize;
+	Vec3d mapR, mapT;
+	Mat map1, map2;
+};
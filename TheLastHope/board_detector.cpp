@@ -0,0 +1,125 @@
+#include <opencv2/opencv_modules.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+#ifdef HAVE_OPENCV_ARUCO
+#include <opencv2/aruco/charuco.hpp>
+#endif
+#include "board_detector.hpp"
+
+using namespace cv;
+using namespace std;
+
+PartialBoardDetector::PartialBoardDetector(Size boardSize, float squareSize, Size minGrid, int maxBoards,
+	bool charuco, float markerSize, int dictionary)
+	: boardSize(boardSize), squareSize(squareSize), minGrid(minGrid), maxBoards(std::max(maxBoards, 1)),
+	  charuco(charuco), markerSize(markerSize), dictionary(dictionary)
+{
+}
+
+bool PartialBoardDetector::charucoAvailable()
+{
+#ifdef HAVE_OPENCV_ARUCO
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool PartialBoardDetector::detect(const Mat& image, vector<BoardView>& views) const
+{
+	Mat gray;
+	if (image.channels() == 1)
+		gray = image;
+	else
+		cvtColor(image, gray, COLOR_BGR2GRAY);
+	return charuco ? detectCharuco(gray, views) : detectGrids(gray, views);
+}
+
+// Fill the hull of a found grid, grown by about one square, so the next search skips it
+static void blank_grid(Mat& gray, const vector<Point2f>& corners)
+{
+	vector<Point2f> hull;
+	convexHull(corners, hull);
+	Point2f c(0, 0);
+	for (const Point2f& p : hull)
+		c += p;
+	c *= 1.f / hull.size();
+	const float square = (float)norm(corners[1] - corners[0]);
+
+	vector<Point> grown;
+	for (const Point2f& p : hull)
+	{
+		Point2f d = p - c;
+		float len = (float)norm(d);
+		grown.push_back(len > 0 ? Point(c + d * ((len + square) / len)) : Point(p));
+	}
+	fillConvexPoly(gray, grown, Scalar::all(128));
+}
+
+bool PartialBoardDetector::detectGrids(const Mat& gray, vector<BoardView>& views) const
+{
+	Mat work = gray;
+	bool any = false;
+	for (int b = 0; b < maxBoards; b++)
+	{
+		vector<Point2f> corners;
+		Mat meta;
+		if (!findChessboardCornersSBWithMeta(work, minGrid, corners,
+				CALIB_CB_NORMALIZE_IMAGE | CALIB_CB_EXHAUSTIVE | CALIB_CB_LARGER, meta))
+			break;
+
+		const Size grid = meta.empty() ? minGrid : meta.size();
+		if ((size_t)grid.area() != corners.size())
+			break;
+
+		BoardView view;
+		view.imagePoints = corners;
+		view.objectPoints.reserve(corners.size());
+		for (int i = 0; i < grid.height; i++)
+			for (int j = 0; j < grid.width; j++)
+				view.objectPoints.push_back(Point3f(j * squareSize, i * squareSize, 0));
+		views.push_back(view);
+		any = true;
+
+		if (b + 1 < maxBoards)
+		{
+			if (work.data == gray.data)
+				work = gray.clone();
+			blank_grid(work, corners);
+		}
+	}
+	return any;
+}
+
+bool PartialBoardDetector::detectCharuco(const Mat& gray, vector<BoardView>& views) const
+{
+#ifdef HAVE_OPENCV_ARUCO
+	Ptr<aruco::Dictionary> dict = aruco::getPredefinedDictionary(dictionary);
+	// boardSize counts inner corners, the ChArUco board counts squares
+	Ptr<aruco::CharucoBoard> board = aruco::CharucoBoard::create(boardSize.width + 1, boardSize.height + 1,
+		squareSize, markerSize, dict);
+
+	vector<vector<Point2f> > markerCorners;
+	vector<int> markerIds;
+	aruco::detectMarkers(gray, dict, markerCorners, markerIds);
+	if (markerIds.empty())
+		return false;
+
+	vector<Point2f> corners;
+	vector<int> ids;
+	aruco::interpolateCornersCharuco(markerCorners, markerIds, gray, board, corners, ids);
+	if ((int)ids.size() < std::max(minGrid.area(), 6))
+		return false;
+
+	BoardView view;
+	view.imagePoints = corners;
+	for (int id : ids)
+		view.objectPoints.push_back(board->chessboardCorners[id]);
+	views.push_back(view);
+	return true;
+#else
+	(void)gray;
+	(void)views;
+	return false;
+#endif
+}
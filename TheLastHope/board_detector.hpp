@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+using namespace cv;
+using namespace std;
+
+// One board seen in a frame: the detected image points and the board points they belong to
+struct BoardView
+{
+	vector<Point2f> imagePoints;
+	vector<Point3f> objectPoints;
+};
+
+// Finds boards that are only partly in view, and several boards per frame.
+// In chessboard mode any grid of at least minGrid inner corners is accepted (findChessboardCornersSB
+// with CALIB_CB_LARGER); without markers the position of that grid on the board is unknown, so each
+// view gets its own board coordinates, which is all calibrateCamera needs. Found boards are blanked
+// out and the frame is searched again, up to maxBoards times.
+// In ChArUco mode (only when OpenCV is built with the aruco module) the markers identify every
+// corner, so any subset of at least minGrid.area() corners maps onto the real board coordinates.
+class PartialBoardDetector
+{
+public:
+	PartialBoardDetector(Size boardSize, float squareSize, Size minGrid, int maxBoards = 1,
+		bool charuco = false, float markerSize = 0, int dictionary = 0);
+
+	static bool charucoAvailable();
+
+	// Appends the boards found in image to views; false if there was none
+	bool detect(const Mat& image, vector<BoardView>& views) const;
+
+private:
+	bool detectGrids(const Mat& gray, vector<BoardView>& views) const;
+	bool detectCharuco(const Mat& gray, vector<BoardView>& views) const;
+
+	Size boardSize;
+	float squareSize;
+	Size minGrid;
+	int maxBoards;
+	bool charuco;
+	float markerSize;
+	int dictionary;
+};
@@ -0,0 +1,46 @@
+#include <tuple>
+#include "board_model.hpp"
+
+using namespace cv;
+using namespace std;
+
+BoardModel::BoardModel(Size boardSize, float squareSize, bool asymmetric, float gridWidth)
+	: boardSize(boardSize), squareSize(squareSize), asymmetric(asymmetric), gridWidth(gridWidth)
+{
+	corners.resize((size_t)boardSize.area());
+	planarCorners.resize(corners.size());
+	for (int i = 0; i < boardSize.height; i++)
+	{
+		for (int j = 0; j < boardSize.width; j++)
+		{
+			const float x = (asymmetric ? 2 * j + i % 2 : j) * squareSize;
+			corners[i * boardSize.width + j] = Point3f(x, i * squareSize, 0);
+		}
+	}
+	// the measured grid width moves the top-right point, which calibrateCameraRO keeps fixed
+	if (gridWidth > 0 && boardSize.width > 1)
+		corners[boardSize.width - 1].x = corners[0].x + gridWidth;
+	else
+		this->gridWidth = corners[boardSize.width - 1].x - corners[0].x;
+
+	for (size_t i = 0; i < corners.size(); i++)
+		planarCorners[i] = Point2f(corners[i].x, corners[i].y);
+
+	axisPoints.push_back(Point3f(3 * squareSize, 0, 0));
+	axisPoints.push_back(Point3f(0, 3 * squareSize, 0));
+	axisPoints.push_back(Point3f(0, 0, 3 * squareSize));
+}
+
+Ptr<const BoardModel> BoardModel::get(Size boardSize, float squareSize, bool asymmetric, float gridWidth)
+{
+	typedef tuple<int, int, float, bool, float> Key;
+	static map<Key, Ptr<const BoardModel> > registry;
+	static mutex lock;
+
+	const Key key(boardSize.width, boardSize.height, squareSize, asymmetric, gridWidth > 0 ? gridWidth : 0.f);
+	lock_guard<mutex> guard(lock);
+	Ptr<const BoardModel>& model = registry[key];
+	if (!model)
+		model = Ptr<const BoardModel>(new BoardModel(boardSize, squareSize, asymmetric, gridWidth));
+	return model;
+}
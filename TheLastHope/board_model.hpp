@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <mutex>
+
+#include <opencv2/core.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Immutable geometry of a calibration board, built once per configuration and shared by
+// every stage (calibration solves, pose estimation, overlays) through BoardModel::get.
+struct BoardModel
+{
+	Size boardSize;
+	float squareSize;
+	bool asymmetric;              // asymmetric circles grid layout
+	float gridWidth;              // distance between the first and last point of the first row
+
+	vector<Point3f> corners;      // object points, row by row, on the z = 0 plane
+	vector<Point2f> planarCorners;// the same points in board plane coordinates, for homographies
+	vector<Point3f> axisPoints;   // ends of the x, y and z axes drawn over the board, 3 squares long
+
+	// The shared model of a board; gridWidth <= 0 keeps the nominal width.
+	static Ptr<const BoardModel> get(Size boardSize, float squareSize, bool asymmetric, float gridWidth = 0);
+
+private:
+	BoardModel(Size boardSize, float squareSize, bool asymmetric, float gridWidth);
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+// Blocking FIFO with a fixed capacity, used to connect the threads of a processing pipeline.
+// push blocks while the queue is full and pop while it is empty; after close() pushes are
+// refused and pop drains what is left, then returns false.
+template<typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+	bool push(T item)
+	{
+		unique_lock<mutex> guard(lock);
+		notFull.wait(guard, [this] { return closed || items.size() < capacity; });
+		if (closed)
+			return false;
+		items.push_back(std::move(item));
+		notEmpty.notify_one();
+		return true;
+	}
+
+	bool pop(T& item)
+	{
+		unique_lock<mutex> guard(lock);
+		notEmpty.wait(guard, [this] { return closed || !items.empty(); });
+		if (items.empty())
+			return false;
+		item = std::move(items.front());
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	void close()
+	{
+		unique_lock<mutex> guard(lock);
+		closed = true;
+		notFull.notify_all();
+		notEmpty.notify_all();
+	}
+
+private:
+	size_t capacity;
+	bool closed;
+	deque<T> items;
+	mutex lock;
+	condition_variable notFull;
+	condition_variable notEmpty;
+};
@@ -0,0 +1,130 @@
+#include <iostream>
+#include <chrono>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "calibration_store.hpp"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+CalibrationStore::CalibrationStore(const string& fileName, int pollMs)
+	: fileName(fileName), pollMs(std::max(pollMs, 10)), version(0), loadedStamp(-1), stopping(false)
+{
+	if (!reload())
+	{
+		cerr << "No usable calibration in " << fileName << endl;
+		return;
+	}
+	watcher = thread(&CalibrationStore::watch, this);
+}
+
+CalibrationStore::~CalibrationStore()
+{
+	stopping = true;
+	if (watcher.joinable())
+		watcher.join();
+}
+
+Ptr<const LoadedCalibration> CalibrationStore::current() const
+{
+	lock_guard<mutex> guard(lock);
+	return active;
+}
+
+bool CalibrationStore::fileStamp(int64_t& stamp) const
+{
+	struct stat st;
+	if (stat(fileName.c_str(), &st) != 0)
+		return false;
+	stamp = (int64_t)st.st_mtime * 1000003 + (int64_t)st.st_size;
+	return true;
+}
+
+bool CalibrationStore::reload()
+{
+	int64_t stamp = -1;
+	fileStamp(stamp);
+
+	Ptr<LoadedCalibration> next = makePtr<LoadedCalibration>();
+	if (!load_calibration(fileName, next->calib))
+	{
+		loadedStamp = stamp;   // do not retry the same broken file
+		if (current())
+			cerr << "Keeping the previous calibration, " << fileName << " is not valid" << endl;
+		return false;
+	}
+	if (next->calib.fisheye)
+		cerr << "Warning: " << fileName << " holds a fisheye model, the pose loop uses it as a pinhole model" << endl;
+
+	// build the tables here, not in the first frame after the swap
+	next->undistorter = makePtr<RoiUndistorter>(next->calib.cameraMatrix, next->calib.distCoeffs,
+		next->calib.imageSize);
+	next->undistorter->prepare(Rect(Point(0, 0), next->calib.imageSize));
+	next->version = ++version;
+	loadedStamp = stamp;
+
+	cout << "Calibration " << next->version << " loaded from " << fileName << endl;
+	lock_guard<mutex> guard(lock);
+	active = next;
+	return true;
+}
+
+void CalibrationStore::watch()
+{
+#ifdef __linux__
+	// watch the directory: writers often replace the file instead of rewriting it
+	size_t slash = fileName.find_last_of('/');
+	string dir = slash == string::npos ? string(".") : fileName.substr(0, slash);
+	string name = slash == string::npos ? fileName : fileName.substr(slash + 1);
+
+	int fd = inotify_init1(IN_NONBLOCK);
+	if (fd >= 0 && inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) >= 0)
+	{
+		char buffer[4096];
+		while (!stopping)
+		{
+			pollfd p = { fd, POLLIN, 0 };
+			if (poll(&p, 1, pollMs) <= 0)
+				continue;
+			bool changed = false;
+			ssize_t len;
+			while ((len = read(fd, buffer, sizeof(buffer))) > 0)
+			{
+				for (char* ptr = buffer; ptr < buffer + len; )
+				{
+					inotify_event* ev = (inotify_event*)ptr;
+					if (ev->len && name == ev->name && (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)))
+						changed = true;
+					ptr += sizeof(inotify_event) + ev->len;
+				}
+			}
+			if (changed)
+				reload();
+		}
+		close(fd);
+		return;
+	}
+	if (fd >= 0)
+		close(fd);
+	cerr << "inotify is not available, polling " << fileName << endl;
+#endif
+	while (!stopping)
+	{
+		this_thread::sleep_for(chrono::milliseconds(pollMs));
+		int64_t stamp;
+		if (fileStamp(stamp) && stamp != loadedStamp)
+		{
+			// let the writer finish: reload once the stamp holds still for a moment
+			this_thread::sleep_for(chrono::milliseconds(pollMs / 2));
+			int64_t settled;
+			if (fileStamp(settled) && settled == stamp)
+				reload();
+		}
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+
+#include "undistortion.hpp"
+
+using namespace cv;
+using namespace std;
+
+// A validated calibration, never modified once published. The undistorter comes with the
+// full-frame tables already built; it belongs to the single loop that uses this calibration.
+struct LoadedCalibration
+{
+	CameraCalibration calib;
+	Ptr<RoiUndistorter> undistorter;
+	uint64_t version;
+};
+
+// Holds the calibration of a running pose loop and replaces it when the file changes on disk.
+// A new file is loaded and validated on the watcher thread; only a complete, valid calibration
+// is swapped in, otherwise the error is reported and the previous one stays active. Changes are
+// noticed through inotify on Linux and by polling the modification time elsewhere.
+class CalibrationStore
+{
+public:
+	explicit CalibrationStore(const string& fileName, int pollMs = 500);
+	~CalibrationStore();
+
+	bool isOpen() const { return (bool)current(); }
+
+	// The active calibration; stays valid for as long as the caller holds it
+	Ptr<const LoadedCalibration> current() const;
+
+private:
+	bool reload();
+	void watch();
+	bool fileStamp(int64_t& stamp) const;
+
+	string fileName;
+	int pollMs;
+	uint64_t version;
+	int64_t loadedStamp;
+
+	mutable mutex lock;
+	Ptr<const LoadedCalibration> active;
+
+	atomic<bool> stopping;
+	thread watcher;
+};
@@ -4,6 +4,7 @@
 #include <ctime>
 #include <cstdio>
 #include <fstream>
+#include <algorithm>
 
 #include <opencv2/core.hpp>
 #include <opencv2/core/utility.hpp>
@@ -14,6 +15,25 @@
 #include <opencv2/highgui.hpp>
 #include <opencv2/core/utils/filesystem.hpp>
 #include "utils.hpp"
+#include "detection_cache.hpp"
+#include "image_loader.hpp"
+#include "undistortion.hpp"
+#include "telemetry.hpp"
+#include "frame_recorder.hpp"
+#include "board_model.hpp"
+#include "board_detector.hpp"
+#include "coverage.hpp"
+#include "pose_math.hpp"
+#include "pose_filter.hpp"
+#include "calibration_store.hpp"
+#include "capture_pipeline.hpp"
+#include "chessboard_detector.hpp"
+#include "circle_grid_detector.hpp"
+#include "frame_pool.hpp"
+#include "quality_gate.hpp"
+#include "sparse_calibration.hpp"
+#include "birds_eye.hpp"
+#include "video_sampler.hpp"
 
 using namespace cv;
 using namespace std;
@@ -22,8 +42,10 @@ class Settings
 {
 public:
     Settings() : goodInput(false) {}
-    enum Pattern { NOT_EXISTING, CHESSBOARD, CIRCLES_GRID, ASYMMETRIC_CIRCLES_GRID };
-    enum InputType { INVALID, CAMERA, VIDEO_FILE, IMAGE_LIST };
+    enum Pattern { NOT_EXISTING, CHESSBOARD, CIRCLES_GRID, ASYMMETRIC_CIRCLES_GRID, CHARUCO };
+    enum InputType { INVALID, CAMERA, VIDEO_FILE, IMAGE_LIST, REPLAY };
+    enum Region { REGION_FULL, REGION_BOARD, REGION_SELECTED };
+    enum Solver { SOLVER_DENSE, SOLVER_SPARSE };
 
     void write(FileStorage& fs) const                        //Write serialization for this class
     {
@@ -36,6 +58,34 @@ public:
                   << "Calibrate_FixAspectRatio" << aspectRatio
                   << "Calibrate_AssumeZeroTangentialDistortion" << calibZeroTangentDist
                   << "Calibrate_FixPrincipalPointAtTheCenter" << calibFixPrincipalPoint
+                  << "Calibrate_CompareModels" << compareModels
+                  << "Calibrate_BootstrapSamples" << bootstrapSamples
+                  << "Calibrate_Solver" << solverToUse
+                  << "Calibrate_PartialBoards" << partialBoards
+                  << "Calibrate_MinPartialGrid" << minPartialGrid
+                  << "Calibrate_MaxBoardsPerFrame" << maxBoardsPerFrame
+                  << "Calibrate_CharucoMarkerSize" << charucoMarkerSize
+                  << "Calibrate_CharucoDictionary" << charucoDictionary
+                  << "Calibrate_CoverageTarget" << coverageTarget
+                  << "Calibrate_MinPoseBins" << minPoseBins
+                  << "Quality_MinSharpness" << minSharpness
+                  << "Quality_MaxClipped" << maxClipped
+                  << "Quality_MaxMotion" << maxMotion
+                  << "Calibrate_ChessboardDetector" << detectorToUse
+                  << "Calibrate_DetectorBudgetMs" << detectorBudgetMs
+                  << "CirclesGrid_MinThreshold" << blobMinThreshold
+                  << "CirclesGrid_MaxThreshold" << blobMaxThreshold
+                  << "CirclesGrid_ThresholdStep" << blobThresholdStep
+                  << "CirclesGrid_AdaptiveRange" << blobAdaptiveRange
+                  << "CirclesGrid_MinRepeatability" << blobMinRepeatability
+                  << "CirclesGrid_MinDistBetweenBlobs" << blobMinDist
+                  << "CirclesGrid_BlobColor" << blobColor
+                  << "CirclesGrid_MinArea" << blobMinArea
+                  << "CirclesGrid_MaxArea" << blobMaxArea
+                  << "CirclesGrid_MinCircularity" << blobMinCircularity
+                  << "CirclesGrid_MinInertiaRatio" << blobMinInertia
+                  << "CirclesGrid_MinConvexity" << blobMinConvexity
+                  << "CirclesGrid_ReuseRoi" << blobReuseRoi
 
                   << "Write_DetectedFeaturePoints" << writePoints
                   << "Write_extrinsicParameters"   << writeExtrinsics
@@ -45,10 +95,39 @@ public:
                   << "Write_xmlOutputFolder" << xmlOutputDirectory
 
                   << "Show_UndistortedImage" << showUndistorsed
+                  << "Show_PreviewReduction" << previewReduction
+                  << "Show_Coverage" << showCoverage
+                  << "Pose_CalibrationFile" << poseCalibrationFile
+                  << "Pose_UndistortRegion" << poseRegionToUse
+                  << "Pose_RegionMargin" << poseRegionMargin
+                  << "Pose_TelemetryOutput" << telemetryOutput
+                  << "Pose_TelemetryQueueSize" << telemetryQueueSize
+                  << "Pose_Filter" << poseFilter
+                  << "Pose_FilterProcessNoise" << poseProcessNoise
+                  << "Pose_FilterMeasurementNoise" << poseMeasurementNoise
+                  << "Pose_MaxPredictedFrames" << poseMaxPredicted
+                  << "Pose_BirdsEye" << birdsEye
+                  << "Pose_BirdsEyePixelsPerUnit" << birdsEyeScale
+                  << "Pose_BirdsEyeMargin" << birdsEyeMargin
+                  << "Pose_BirdsEyeRefreshAngle" << birdsEyeRefreshAngle
+                  << "Pose_BirdsEyeRefreshShift" << birdsEyeRefreshShift
+                  << "Pose_BirdsEyeOutput" << birdsEyeOutput
 
                   << "Input_FlipAroundHorizontalAxis" << flipVertical
                   << "Input_Delay" << delay
+                  << "Input_VideoStride" << videoStride
+                  << "Input_VideoCandidates" << videoCandidates
+                  << "Input_VideoSegments" << videoSegments
                   << "Input" << input
+                  << "Input_DetectionCache" << detectionCacheFile
+                  << "Input_PrefetchThreads" << prefetchThreads
+                  << "Input_PrefetchDepth" << prefetchDepth
+                  << "Input_KeepDecodedImages" << keepDecoded
+                  << "Input_PipelineThreads" << pipelineThreads
+                  << "Input_FramePoolSize" << framePoolSize
+                  << "Input_RecordFile" << recordFile
+                  << "Input_RecordCompression" << recordCompression
+                  << "Input_ReplayRealtime" << replayRealtime
            << "}";
     }
     void read(const FileNode& node)                          //Read serialization for this class
@@ -68,10 +147,78 @@ public:
         node["Calibrate_AssumeZeroTangentialDistortion"] >> calibZeroTangentDist;
         node["Calibrate_FixPrincipalPointAtTheCenter"] >> calibFixPrincipalPoint;
         node["Calibrate_UseFisheyeModel"] >> useFisheye;
+        node["Calibrate_CompareModels"] >> compareModels;
+        node["Calibrate_BootstrapSamples"] >> bootstrapSamples;
+        node["Calibrate_Solver"] >> solverToUse;
+        node["Calibrate_PartialBoards"] >> partialBoards;
+        node["Calibrate_MinPartialGrid"] >> minPartialGrid;
+        node["Calibrate_MaxBoardsPerFrame"] >> maxBoardsPerFrame;
+        node["Calibrate_CharucoMarkerSize"] >> charucoMarkerSize;
+        node["Calibrate_CharucoDictionary"] >> charucoDictionary;
+        node["Calibrate_CoverageTarget"] >> coverageTarget;
+        node["Calibrate_MinPoseBins"] >> minPoseBins;
+        node["Quality_MinSharpness"] >> minSharpness;
+        node["Quality_MaxClipped"] >> maxClipped;
+        node["Quality_MaxMotion"] >> maxMotion;
+        node["Calibrate_ChessboardDetector"] >> detectorToUse;
+        node["Calibrate_DetectorBudgetMs"] >> detectorBudgetMs;
+        node["CirclesGrid_MinThreshold"] >> blobMinThreshold;
+        node["CirclesGrid_MaxThreshold"] >> blobMaxThreshold;
+        node["CirclesGrid_ThresholdStep"] >> blobThresholdStep;
+        node["CirclesGrid_AdaptiveRange"] >> blobAdaptiveRange;
+        node["CirclesGrid_MinRepeatability"] >> blobMinRepeatability;
+        node["CirclesGrid_MinDistBetweenBlobs"] >> blobMinDist;
+        node["CirclesGrid_BlobColor"] >> blobColor;
+        node["CirclesGrid_MaxArea"] >> blobMaxArea;
+        {
+            // a missing blob filter keeps the SimpleBlobDetector default; 0 only turns off one given in the file
+            const SimpleBlobDetector::Params defaults;
+            auto readFilter = [&node](const char* key, float& value, float fallback)
+            {
+                if (node[key].empty())
+                    value = fallback;
+                else
+                    node[key] >> value;
+            };
+            readFilter("CirclesGrid_MinArea", blobMinArea, defaults.minArea);
+            readFilter("CirclesGrid_MinCircularity", blobMinCircularity, defaults.filterByCircularity ? defaults.minCircularity : 0);
+            readFilter("CirclesGrid_MinInertiaRatio", blobMinInertia, defaults.filterByInertia ? defaults.minInertiaRatio : 0);
+            readFilter("CirclesGrid_MinConvexity", blobMinConvexity, defaults.filterByConvexity ? defaults.minConvexity : 0);
+        }
+        node["CirclesGrid_ReuseRoi"] >> blobReuseRoi;
         node["Input_FlipAroundHorizontalAxis"] >> flipVertical;
         node["Show_UndistortedImage"] >> showUndistorsed;
         node["Input"] >> input;
         node["Input_Delay"] >> delay;
+        node["Input_VideoStride"] >> videoStride;
+        node["Input_VideoCandidates"] >> videoCandidates;
+        node["Input_VideoSegments"] >> videoSegments;
+        node["Input_DetectionCache"] >> detectionCacheFile;
+        node["Input_PrefetchThreads"] >> prefetchThreads;
+        node["Input_PrefetchDepth"] >> prefetchDepth;
+        node["Input_KeepDecodedImages"] >> keepDecoded;
+        node["Input_PipelineThreads"] >> pipelineThreads;
+        node["Input_FramePoolSize"] >> framePoolSize;
+        node["Input_RecordFile"] >> recordFile;
+        node["Input_RecordCompression"] >> recordCompression;
+        node["Input_ReplayRealtime"] >> replayRealtime;
+        node["Show_PreviewReduction"] >> previewReduction;
+        node["Show_Coverage"] >> showCoverage;
+        node["Pose_CalibrationFile"] >> poseCalibrationFile;
+        node["Pose_UndistortRegion"] >> poseRegionToUse;
+        node["Pose_RegionMargin"] >> poseRegionMargin;
+        node["Pose_TelemetryOutput"] >> telemetryOutput;
+        node["Pose_TelemetryQueueSize"] >> telemetryQueueSize;
+        node["Pose_Filter"] >> poseFilter;
+        node["Pose_FilterProcessNoise"] >> poseProcessNoise;
+        node["Pose_FilterMeasurementNoise"] >> poseMeasurementNoise;
+        node["Pose_MaxPredictedFrames"] >> poseMaxPredicted;
+        node["Pose_BirdsEye"] >> birdsEye;
+        node["Pose_BirdsEyePixelsPerUnit"] >> birdsEyeScale;
+        node["Pose_BirdsEyeMargin"] >> birdsEyeMargin;
+        node["Pose_BirdsEyeRefreshAngle"] >> birdsEyeRefreshAngle;
+        node["Pose_BirdsEyeRefreshShift"] >> birdsEyeRefreshShift;
+        node["Pose_BirdsEyeOutput"] >> birdsEyeOutput;
         node["Fix_K1"] >> fixK1;
         node["Fix_K2"] >> fixK2;
         node["Fix_K3"] >> fixK3;
@@ -98,6 +245,23 @@ public:
             cerr << "Invalid number of frames " << nrFrames << endl;
             goodInput = false;
         }
+        if (bootstrapSamples < 0)
+        {
+            cerr << "Invalid number of bootstrap samples " << bootstrapSamples << endl;
+            goodInput = false;
+        }
+        if (coverageTarget < 0 || coverageTarget > 1)
+        {
+            cerr << "Invalid coverage target " << coverageTarget << endl;
+            goodInput = false;
+        }
+        if (previewReduction <= 0)
+            previewReduction = 1;
+        if (previewReduction != 1 && previewReduction != 2 && previewReduction != 4 && previewReduction != 8)
+        {
+            cerr << "Invalid preview reduction " << previewReduction << ", using 1" << endl;
+            previewReduction = 1;
+        }
 
         if (input.empty())      // Check for valid input
                 inputType = INVALID;
@@ -115,7 +279,12 @@ public:
                 {
                     inputType = IMAGE_LIST;
                     nrFrames = (nrFrames < (int)imageList.size()) ? nrFrames : (int)imageList.size();
+                    if (prefetchThreads > 0)
+                        imageLoader = makePtr<ImagePrefetcher>(imageList, IMREAD_COLOR, prefetchThreads,
+                                                               (size_t)std::max(prefetchDepth, 1), keepDecoded);
                 }
+                else if (isRecording(input))
+                    inputType = REPLAY;
                 else
                     inputType = VIDEO_FILE;
             }
@@ -123,44 +292,158 @@ public:
                 inputCapture.open(cameraID);
             if (inputType == VIDEO_FILE)
                 inputCapture.open(input);
-            if (inputType != IMAGE_LIST && !inputCapture.isOpened())
+            if (inputType == VIDEO_FILE && inputCapture.isOpened() && (videoStride > 1 || videoCandidates > 0))
+            {
+                // sampled frames come from the sampler's own captures
+                inputCapture.release();
+                videoSampler = makePtr<VideoSampler>(input, videoStride, videoCandidates, videoSegments);
+                if (!videoSampler->isOpen())
+                    inputType = INVALID;
+            }
+            if (inputType == REPLAY)
+            {
+                replayer = makePtr<FrameReplayer>(input, replayRealtime);
+                if (!replayer->isOpen())
+                    inputType = INVALID;
+            }
+            else if (inputType != IMAGE_LIST && !videoSampler && !inputCapture.isOpened())
                     inputType = INVALID;
         }
+        if (inputType != INVALID && !recordFile.empty())
+            recorder = makePtr<FrameRecorder>(recordFile, recordCompression);
+        if (framePoolSize < 0)
+            framePoolSize = 0;
+        framePool = makePtr<FramePool>("input", (size_t)framePoolSize);
         if (inputType == INVALID)
         {
             cerr << " Input does not exist: " << input;
             goodInput = false;
         }
 
-        flag = 0;
-        if(calibFixPrincipalPoint) flag |= CALIB_FIX_PRINCIPAL_POINT;
-        if(calibZeroTangentDist)   flag |= CALIB_ZERO_TANGENT_DIST;
-        if(aspectRatio)            flag |= CALIB_FIX_ASPECT_RATIO;
-        if(fixK1)                  flag |= CALIB_FIX_K1;
-        if(fixK2)                  flag |= CALIB_FIX_K2;
-        if(fixK3)                  flag |= CALIB_FIX_K3;
-        if(fixK4)                  flag |= CALIB_FIX_K4;
-        if(fixK5)                  flag |= CALIB_FIX_K5;
-
-        if (useFisheye) {
-            // the fisheye model has its own enum, so overwrite the flags
-            flag = fisheye::CALIB_FIX_SKEW | fisheye::CALIB_RECOMPUTE_EXTRINSIC;
-            if(fixK1)                   flag |= fisheye::CALIB_FIX_K1;
-            if(fixK2)                   flag |= fisheye::CALIB_FIX_K2;
-            if(fixK3)                   flag |= fisheye::CALIB_FIX_K3;
-            if(fixK4)                   flag |= fisheye::CALIB_FIX_K4;
-            if (calibFixPrincipalPoint) flag |= fisheye::CALIB_FIX_PRINCIPAL_POINT;
-        }
+        pinholeFlag = 0;
+        if(calibFixPrincipalPoint) pinholeFlag |= CALIB_FIX_PRINCIPAL_POINT;
+        if(calibZeroTangentDist)   pinholeFlag |= CALIB_ZERO_TANGENT_DIST;
+        if(aspectRatio)            pinholeFlag |= CALIB_FIX_ASPECT_RATIO;
+        if(fixK1)                  pinholeFlag |= CALIB_FIX_K1;
+        if(fixK2)                  pinholeFlag |= CALIB_FIX_K2;
+        if(fixK3)                  pinholeFlag |= CALIB_FIX_K3;
+        if(fixK4)                  pinholeFlag |= CALIB_FIX_K4;
+        if(fixK5)                  pinholeFlag |= CALIB_FIX_K5;
+
+        // the fisheye model has its own enum, so keep its flags apart
+        fisheyeFlag = fisheye::CALIB_FIX_SKEW | fisheye::CALIB_RECOMPUTE_EXTRINSIC;
+        if(fixK1)                   fisheyeFlag |= fisheye::CALIB_FIX_K1;
+        if(fixK2)                   fisheyeFlag |= fisheye::CALIB_FIX_K2;
+        if(fixK3)                   fisheyeFlag |= fisheye::CALIB_FIX_K3;
+        if(fixK4)                   fisheyeFlag |= fisheye::CALIB_FIX_K4;
+        if (calibFixPrincipalPoint) fisheyeFlag |= fisheye::CALIB_FIX_PRINCIPAL_POINT;
+
+        flag = useFisheye ? fisheyeFlag : pinholeFlag;
 
         calibrationPattern = NOT_EXISTING;
         if (!patternToUse.compare("CHESSBOARD")) calibrationPattern = CHESSBOARD;
         if (!patternToUse.compare("CIRCLES_GRID")) calibrationPattern = CIRCLES_GRID;
         if (!patternToUse.compare("ASYMMETRIC_CIRCLES_GRID")) calibrationPattern = ASYMMETRIC_CIRCLES_GRID;
+        if (!patternToUse.compare("CHARUCO")) calibrationPattern = CHARUCO;
         if (calibrationPattern == NOT_EXISTING)
         {
             cerr << " Camera calibration mode does not exist: " << patternToUse << endl;
             goodInput = false;
         }
+        detectorBackend = ChessboardDetector::CLASSIC;
+        if (detectorToUse.empty() || !detectorToUse.compare("CLASSIC")) detectorBackend = ChessboardDetector::CLASSIC;
+        else if (!detectorToUse.compare("SB")) detectorBackend = ChessboardDetector::SB;
+        else if (!detectorToUse.compare("SADDLE")) detectorBackend = ChessboardDetector::SADDLE;
+        else
+        {
+            cerr << " Chessboard detector does not exist: " << detectorToUse << endl;
+            goodInput = false;
+        }
+        if (detectorBudgetMs <= 0)
+            detectorBudgetMs = 5;
+
+        // circle grids: missing or invalid keys fall back on the SimpleBlobDetector defaults
+        // (the filters already did in read), a zero ratio or a negative color turns that filter off
+        if (blobThresholdStep <= 0)
+            blobThresholdStep = 10;
+        if (blobMaxThreshold <= blobMinThreshold)
+        {
+            blobMinThreshold = 50;
+            blobMaxThreshold = 220;
+        }
+        if (blobMinRepeatability < 1)
+            blobMinRepeatability = 2;
+        if (blobMinDist <= 0)
+            blobMinDist = 10;
+        if (blobMaxArea <= 0)
+            blobMaxArea = 5000;
+        if (blobAdaptiveRange < 0)
+            blobAdaptiveRange = 0;
+        blobParams = SimpleBlobDetector::Params();
+        blobParams.minThreshold = (float)blobMinThreshold;
+        blobParams.maxThreshold = (float)blobMaxThreshold;
+        blobParams.thresholdStep = (float)blobThresholdStep;
+        blobParams.minRepeatability = (size_t)blobMinRepeatability;
+        blobParams.minDistBetweenBlobs = blobMinDist;
+        blobParams.filterByColor = blobColor >= 0;
+        blobParams.blobColor = (uchar)std::min(std::max(blobColor, 0), 255);
+        blobParams.filterByArea = true;
+        blobParams.minArea = blobMinArea;
+        blobParams.maxArea = blobMaxArea;
+        blobParams.filterByCircularity = blobMinCircularity > 0;
+        blobParams.minCircularity = blobMinCircularity;
+        blobParams.filterByInertia = blobMinInertia > 0;
+        blobParams.minInertiaRatio = blobMinInertia;
+        blobParams.filterByConvexity = blobMinConvexity > 0;
+        blobParams.minConvexity = blobMinConvexity;
+        if (calibrationPattern == CHARUCO && !PartialBoardDetector::charucoAvailable())
+        {
+            cerr << " CHARUCO needs OpenCV built with the aruco module" << endl;
+            goodInput = false;
+        }
+
+        // partially visible boards: any chessboard grid of at least minPartialGrid corners a side,
+        // or whatever ChArUco corners the markers identify
+        if (minPartialGrid < 3)
+            minPartialGrid = 3;
+        partialDetector.release();
+        if (calibrationPattern == CHARUCO)
+            partialDetector = makePtr<PartialBoardDetector>(boardSize, squareSize, Size(minPartialGrid, minPartialGrid),
+                                                            1, true, charucoMarkerSize, charucoDictionary);
+        else if (partialBoards && calibrationPattern == CHESSBOARD)
+            partialDetector = makePtr<PartialBoardDetector>(boardSize, squareSize, Size(minPartialGrid, minPartialGrid),
+                                                            maxBoardsPerFrame);
+        solver = SOLVER_DENSE;
+        if (!solverToUse.compare("SPARSE")) solver = SOLVER_SPARSE;
+        else if (!solverToUse.empty() && solverToUse.compare("DENSE"))
+        {
+            cerr << " Calibration solver does not exist: " << solverToUse << endl;
+            goodInput = false;
+        }
+        if (solver == SOLVER_SPARSE && useFisheye)
+            cerr << "The sparse solver only handles the pinhole model, the fisheye one is solved densely" << endl;
+        poseRegion = REGION_FULL;
+        if (!poseRegionToUse.compare("BOARD")) poseRegion = REGION_BOARD;
+        if (!poseRegionToUse.compare("SELECTED")) poseRegion = REGION_SELECTED;
+        if (poseRegionMargin < 0)
+            poseRegionMargin = 0;
+        if (telemetryQueueSize <= 0)
+            telemetryQueueSize = 1024;
+        if (poseFilter && (poseProcessNoise <= 0 || poseMeasurementNoise <= 0))
+        {
+            cerr << "Invalid pose filter noise " << poseProcessNoise << ", " << poseMeasurementNoise << endl;
+            goodInput = false;
+        }
+        if (poseMaxPredicted < 0)
+            poseMaxPredicted = 0;
+        if (birdsEye && birdsEyeScale <= 0)
+        {
+            cerr << "Invalid bird's-eye scale " << birdsEyeScale << endl;
+            goodInput = false;
+        }
+        if (birdsEyeMargin < 0)
+            birdsEyeMargin = 0;
+
         atImageList = 0;
 
     }
@@ -169,16 +452,77 @@ public:
         Mat result;
         if( inputCapture.isOpened() )
         {
-            Mat view0;
-            inputCapture >> view0;
-            view0.copyTo(result);
+            inputCapture >> captured;
+            result = framePool->get(captured.size(), captured.type());
+            captured.copyTo(result);
         }
         else if( atImageList < imageList.size() )
-            result = imread(imageList[atImageList++], IMREAD_COLOR);
+        {
+            if (imageLoader)
+                result = imageLoader->get(atImageList++);
+            else
+                result = imread(imageList[atImageList++], IMREAD_COLOR);
+        }
+        else if (videoSampler)
+            result = videoSampler->next();
+        else if (replayer)
+            result = replayer->next();
 
+        if (recorder)
+            recorder->frame(result);
         return result;
     }
 
+    // Shared geometry of the configured board; gridWidth <= 0 keeps the nominal width
+    Ptr<const BoardModel> boardModel(float gridWidth = 0) const
+    {
+        return BoardModel::get(boardSize, squareSize, calibrationPattern == ASYMMETRIC_CIRCLES_GRID, gridWidth);
+    }
+
+    // Live inputs (camera, or a replayed camera session) capture on key press
+    bool isLive() const
+    {
+        return inputCapture.isOpened() || inputType == REPLAY;
+    }
+
+    // waitKey that is recorded, or answered from the recording when replaying
+    int waitInput(int delay)
+    {
+        int key;
+        if (replayer)
+        {
+            cv::waitKey(1);    // keep the windows responsive
+            key = replayer->waitKey();
+        }
+        else
+            key = cv::waitKey(delay);
+        if (recorder)
+            recorder->key(key);
+        return key;
+    }
+
+    // setMouseCallback going through the recorder or the replayer
+    void hookMouse(const string& winName, MouseCallback callback, void* userdata)
+    {
+        if (replayer)
+            replayer->setMouseCallback(winName, callback, userdata);
+        else if (recorder)
+            recorder->hookMouse(winName, callback, userdata);
+        else
+            cv::setMouseCallback(winName, callback, userdata);
+    }
+
+    // Drop the callback of winName, e.g. before its userdata goes out of scope
+    void unhookMouse(const string& winName)
+    {
+        if (replayer)
+            replayer->removeMouseCallback(winName);
+        else if (recorder)
+            recorder->unhookMouse(winName);
+        else
+            cv::setMouseCallback(winName, NULL, NULL);
+    }
+
     static bool readStringList( const string& filename, vector<string>& l )
     {
         l.clear();
@@ -194,6 +538,11 @@ public:
         return true;
     }
 
+    static bool isRecording(const string& filename)
+    {
+        return filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".rec") == 0;
+    }
+
     static bool isListOfImages( const string& filename)
     {
         string s(filename);
@@ -210,6 +559,9 @@ public:
     int nrFrames;                // The number of frames to use from the input for calibration
     float aspectRatio;           // The aspect ratio
     int delay;                   // In case of a video input
+    int videoStride;             // Video file: only every videoStride-th frame is decoded (1 = all)
+    int videoCandidates;         // Video file: decode this many frames spread over the video instead (0 = off)
+    int videoSegments;           // Video file: parts of the video sampled in parallel
     bool writePoints;            // Write detected feature points
     bool writeExtrinsics;        // Write extrinsic parameters
     bool writeGrid;              // Write refined 3D target grid points
@@ -220,8 +572,61 @@ public:
     string xmlOutputDirectory;   // The name of the file where to write
     string imgOutputDirectory;   // The name of the file where to write
     bool showUndistorsed;        // Show undistorted images after calibration
+    int previewReduction;        // Decode the undistorted review at 1/2, 1/4 or 1/8 of the resolution
+    bool showCoverage;           // Overlay the image regions already covered by captured corners
+    string poseCalibrationFile;  // Calibration used (and watched) by the pose view; empty = the one written here
+    Region poseRegion;           // Part of the pose view to undistort: full frame, around the board or selected
+    int poseRegionMargin;        // Margin in pixels around the board region
+    string telemetryOutput;      // Binary log file or "unix:<path>" socket for the pose telemetry (empty = off)
+    int telemetryQueueSize;      // Records buffered between the pose loop and the telemetry writer
+    bool poseFilter;             // Smooth and predict the pose with a constant-velocity Kalman filter
+    double poseProcessNoise;     // Kalman process noise per second (radians, squares)
+    double poseMeasurementNoise; // Kalman measurement noise of a solvePnP pose (radians, squares)
+    int poseMaxPredicted;        // Frames a predicted pose is reported for after the board is lost
+    bool birdsEye;               // Show a rectified top-down view of the board plane
+    double birdsEyeScale;        // ... in pixels per unit of squareSize
+    float birdsEyeMargin;        // ... showing this many squares around the board
+    double birdsEyeRefreshAngle; // ... rebuilding its maps when the pose turns by more degrees
+    double birdsEyeRefreshShift; // ... or moves by more units of squareSize
+    string birdsEyeOutput;       // ... and writing it to this video (empty = off)
     string input;                // The input ->
+    string detectionCacheFile;   // On-disk cache of the detected corners of an image list (empty = off)
+    int prefetchThreads;         // Threads decoding the image list ahead of the capture loop (0 = off)
+    int prefetchDepth;           // How many images may be decoded ahead of the capture loop
+    bool keepDecoded;            // Keep the decoded image list in memory for the undistorted review
+    int pipelineThreads;         // Detection threads of the pipelined capture loop (0 = one thread for everything)
+    int framePoolSize;           // Frame buffers recycled by the capture and render stages (0 = allocate every frame)
+    string recordFile;           // Record the session (frames, keys, mouse) to this file (empty = off)
+    bool recordCompression;      // Store the recorded frames as lossless PNG instead of raw
+    bool replayRealtime;         // Replay a recording at its recorded pace instead of as fast as possible
     bool useFisheye;             // use fisheye camera model for calibration
+    bool compareModels;          // solve several lens models on the same views and keep the best
+    int bootstrapSamples;        // number of bootstrap resamples for the confidence intervals (0 = off)
+    Solver solver;               // dense calibrateCamera, or the block-sparse solver for many views
+    bool partialBoards;          // accept chessboards that are only partly in view
+    int minPartialGrid;          // smallest grid (corners a side) accepted from a partial board
+    int maxBoardsPerFrame;       // how many partial boards are searched for in one frame
+    float charucoMarkerSize;     // side of the ChArUco markers, in the unit of squareSize
+    int charucoDictionary;       // predefined aruco dictionary of the ChArUco board
+    double coverageTarget;       // calibrate as soon as this fraction of the image is covered (0 = off)
+    int minPoseBins;             // ... and the views show at least this many different board tilts
+    double minSharpness;         // skip frames whose Laplacian variance is lower (0 = off)
+    double maxClipped;           // skip frames with a larger fraction of under/over-exposed pixels (0 = off)
+    double maxMotion;            // skip frames differing more from the previous one (mean gray levels, 0 = off)
+    double detectorBudgetMs;     // nominal time of the SADDLE prefilter, which sets its working size
+    int blobMinThreshold;        // circle grids: first threshold of the blob search
+    int blobMaxThreshold;        // ... last threshold (exclusive)
+    int blobThresholdStep;       // ... distance between two threshold levels
+    int blobAdaptiveRange;       // ... only sweep this range around the Otsu threshold of the frame (0 = off)
+    int blobMinRepeatability;    // ... levels a blob has to be seen on
+    float blobMinDist;           // ... blobs closer than this are the same blob
+    int blobColor;               // ... 0 = dark circles, 255 = bright circles, -1 = either
+    float blobMinArea;           // ... smallest circle area, in pixels
+    float blobMaxArea;           // ... largest circle area, in pixels
+    float blobMinCircularity;    // ... circularity filter (0 = off)
+    float blobMinInertia;        // ... inertia ratio filter (0 = off)
+    float blobMinConvexity;      // ... convexity filter (0 = off)
+    bool blobReuseRoi;           // ... search around the last grid first
     bool fixK1;                  // fix K1 distortion coefficient
     bool fixK2;                  // fix K2 distortion coefficient
     bool fixK3;                  // fix K3 distortion coefficient
@@ -231,13 +636,27 @@ public:
     int cameraID;
     vector<string> imageList;
     size_t atImageList;
+    Ptr<ImagePrefetcher> imageLoader;
+    Ptr<FrameReplayer> replayer;
+    Ptr<VideoSampler> videoSampler;
+    Ptr<FrameRecorder> recorder;
+    Ptr<FramePool> framePool;
+    Ptr<PartialBoardDetector> partialDetector;   // set when views may hold only part of the board
     VideoCapture inputCapture;
     InputType inputType;
+    ChessboardDetector::Backend detectorBackend;
+    SimpleBlobDetector::Params blobParams;
     bool goodInput;
     int flag;
+    int pinholeFlag;
+    int fisheyeFlag;
 
 private:
     string patternToUse;
+    string poseRegionToUse;
+    string detectorToUse;
+    string solverToUse;
+    Mat captured;                // capture backend buffer, copied into a pooled frame
 
 
 };
@@ -252,72 +671,18 @@ static inline void read(const FileNode& node, Settings& x, const Settings& defau
 
 enum { DETECTION = 0, CAPTURING = 1, CALIBRATED = 2 };
 
-static void calcBoardCornerPositions(Size boardSize, float squareSize, vector<Point3f>& corners,
-    Settings::Pattern patternType /*= Settings::CHESSBOARD*/)
+// A lens model to solve for: the camera model and the solver flags to use with it
+struct CalibrationModel
 {
-    corners.clear();
-
-    switch (patternType)
-    {
-    case Settings::CHESSBOARD:
-    case Settings::CIRCLES_GRID:
-        for (int i = 0; i < boardSize.height; ++i)
-            for (int j = 0; j < boardSize.width; ++j)
-                corners.push_back(Point3f(j * squareSize, i * squareSize, 0));
-        break;
-
-    case Settings::ASYMMETRIC_CIRCLES_GRID:
-        for (int i = 0; i < boardSize.height; i++)
-            for (int j = 0; j < boardSize.width; j++)
-                corners.push_back(Point3f((2 * j + i % 2) * squareSize, i * squareSize, 0));
-        break;
-    default:
-        break;
-    }
-}
+    string name;
+    bool useFisheye;
+    int flag;
+};
 
-//Compute Euler angles of the extrinsic rotations (tyat-bryan rep.) from a rotation matrix.
-cv::Mat rot2euler(const cv::Mat& rotationMatrix)
+static CalibrationModel settingsModel(const Settings& s)
 {
-    cv::Mat euler(3, 1, CV_64F);
-    double m00 = rotationMatrix.at<double>(0, 0);
-    double m01 = rotationMatrix.at<double>(0, 1);
-    double m02 = rotationMatrix.at<double>(0, 2);
-    double m10 = rotationMatrix.at<double>(1, 0);
-    double m11 = rotationMatrix.at<double>(1, 1);
-    double m12 = rotationMatrix.at<double>(1, 2);
-    double m20 = rotationMatrix.at<double>(2, 0);
-    double m21 = rotationMatrix.at<double>(2, 1);
-    double m22 = rotationMatrix.at<double>(2, 2);
-    double x, y, z;
-    // Assuming the angles are in radians.
-    if (m20 < 1)
-    {
-        if (m20 > -1)
-        {
-            x = atan2(m21, m22);
-            y = asin(-m20);
-            z = atan2(m10, m00);
-        }
-        else //m20 = -1
-        {
-            //Not a unique solution: x - z = atan2(-m12,m11)
-            x = 0;
-            y = CV_PI / 2;
-            z = -atan2(-m12, m11);
-        }
-    }
-    else //m20 = +1
-    {
-        //Not a unique solution: x + z = atan2(-m12,m11)
-        x = 0;
-        y = -CV_PI / 2;
-        z = atan2(-m12, m11);
-    }
-    euler.at<double>(0) = x;
-    euler.at<double>(1) = y;
-    euler.at<double>(2) = z;
-    return euler;
+    CalibrationModel model = { s.useFisheye ? "fisheye" : "pinhole", s.useFisheye, s.flag };
+    return model;
 }
 
 static Mat mask;
@@ -362,53 +727,96 @@ static void onMousePoseView(int event, int x, int y, int, void*)
 }
 
 bool runCalibrationAndSave(Settings& s, Size imageSize, Mat&  cameraMatrix, Mat& distCoeffs,
-                           vector<vector<Point2f> > imagePoints, float grid_width, bool release_object);
-
-bool isRotationMatrix(Mat& R) {
-    Mat Rt;
-    transpose(R, Rt);
-    Mat shouldBeIdentity = Rt * R;
-    Mat I = Mat::eye(3, 3, shouldBeIdentity.type());
-
-    return norm(I, shouldBeIdentity) < 1e-6;
+                           vector<vector<Point2f> > imagePoints, const vector<vector<Point3f> >& objectPoints,
+                           float grid_width, bool release_object);
+
+// Collect the views the capture loop would use for an image list straight from the detection cache:
+// from the image the loop starts at, until nrFrames views or enough coverage, as in the loop.
+// Fails as soon as one of the needed images has no valid entry.
+static bool loadCachedDetections(const Settings& s, const DetectionCache& cache, const vector<Point2f>& planarCorners,
+                                 vector<vector<Point2f> >& imagePoints, CoverageMap& coverage, Size& imageSize)
+{
+    vector<vector<Point2f> > cachedPoints;
+    CoverageMap cachedCoverage;
+    for (size_t i = s.atImageList; i < s.imageList.size() && cachedPoints.size() < (size_t)s.nrFrames; i++)
+    {
+        if (s.coverageTarget > 0 && cachedCoverage.enough(s.coverageTarget, s.minPoseBins))
+            break;
+        vector<Point2f> corners;
+        bool found;
+        if (!cache.lookup(s.imageList[i], imageSize, corners, found))
+            return false;
+        if (cachedCoverage.imageSize() != imageSize)
+            cachedCoverage = CoverageMap(imageSize);
+        if (found)
+        {
+            cachedPoints.push_back(corners);
+            cachedCoverage.addView(corners, planarCorners);
+        }
+    }
+    if (cachedPoints.empty())
+        return false;
+    imagePoints.swap(cachedPoints);
+    coverage = cachedCoverage;
+    return true;
 }
 
 void computeChessboardPose(Settings& s) {
-    std::string calibFilePath = s.outputFileName + "/out_calibration.xml";
-    calibFilePath = "xml/out_calibration.xml";
-    cout << "Opening" << calibFilePath << "...." << endl;
-
-    FileStorage fs;
-    if (!fs.open(calibFilePath, FileStorage::READ)) {
-        cerr << "Error" << calibFilePath << "...." << endl;
+    std::string calibFilePath = s.poseCalibrationFile.empty() ? s.xmlOutputDirectory + "/" + s.outputFileName
+                                                              : s.poseCalibrationFile;
+    cout << "Opening " << calibFilePath << "...." << endl;
+
+    // reloaded in the background whenever the file is rewritten
+    CalibrationStore calibrations(calibFilePath);
+    if (!calibrations.isOpen()) {
+        cerr << "Error " << calibFilePath << "...." << endl;
         return;
     }
 
-    int width, height;
+    int width = 0, height = 0;
     Mat K, distCoeff;
-
-    fs["image_width"] >> width;
-    fs["image_height"] >> height;
-    fs["camera_matrix"] >> K;
-    fs["distorsion_coefficients"] >> distCoeff;
-
-    fs.release();
-
-    cout << "Image width = " << width << endl;
-    cout << "Image height = " << height << endl;
-    cout << "k = " << K << endl;
-    cout << "distCoeff = " << distCoeff << endl;
+    Ptr<RoiUndistorter> undistorter;
+    uint64_t calibrationVersion = 0;
 
     const char* winName = "Pose View";
     namedWindow(winName, WINDOW_KEEPRATIO);
 
     vector<Point2f> clickedPoints;
-    cv::setMouseCallback(winName, onMouse, &clickedPoints);
+    s.hookMouse(winName, onMouse, &clickedPoints);
+    // the callback points at clickedPoints: unhook it on every way out of this function
+    struct MouseUnhook
+    {
+        Settings& s;
+        string winName;
+        ~MouseUnhook() { s.unhookMouse(winName); }
+    } unhook = { s, winName };
     Mat view, undistortedView;
+    vector<Rect> selectedRegions;
     vector<Point2f> imagePoints;
-    vector<Point3f> objectPoints;
+    Ptr<const BoardModel> board = s.boardModel();
+    const vector<Point3f>& objectPoints = board->corners;
     Mat Himg2scene, Hscene2img;
-    calcBoardCornerPositions(s.boardSize, s.squareSize, objectPoints, s.calibrationPattern);
+
+    Ptr<TelemetryPublisher> telemetry;
+    if (!s.telemetryOutput.empty())
+        telemetry = makePtr<TelemetryPublisher>(s.telemetryOutput, (size_t)s.telemetryQueueSize);
+    uint64_t frameIndex = 0;
+
+    PoseFilter filter(s.poseProcessNoise, s.poseMeasurementNoise, s.poseMaxPredicted, s.squareSize);
+    Ptr<ChessboardDetector> chessboard = ChessboardDetector::create(s.detectorBackend, s.boardSize,
+        CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_NORMALIZE_IMAGE | CALIB_CB_FAST_CHECK, 11, s.detectorBudgetMs);
+    CircleGridDetector circles(s.boardSize, s.calibrationPattern == Settings::ASYMMETRIC_CIRCLES_GRID, s.blobParams,
+                               s.blobAdaptiveRange, s.blobReuseRoi);
+    int64_t lastTimestampUs = -1;
+
+    // the board plus a margin, top-down; rebuilt with the camera model
+    Ptr<BirdsEyeView> birdsEye;
+    Rect2f birdsEyeArea = boundingRect(board->planarCorners);
+    const float birdsEyeMargin = s.birdsEyeMargin * s.squareSize;
+    birdsEyeArea = Rect2f(birdsEyeArea.x - birdsEyeMargin, birdsEyeArea.y - birdsEyeMargin,
+                          birdsEyeArea.width + 2 * birdsEyeMargin, birdsEyeArea.height + 2 * birdsEyeMargin);
+    Mat birdsEyeFrame;
+    VideoWriter birdsEyeWriter;
     
     //! [get_input]
     for (;;)
@@ -417,55 +825,126 @@ void computeChessboardPose(Settings& s) {
         bool blinkOutput = false;
 
         view = s.nextImage();
-        undistort(view, undistortedView,K, distCoeff);
-        Mat raw_view = view.clone();
+        Mat raw_view = s.framePool->get(view.size(), view.type());
+        view.copyTo(raw_view);
+
+        // pick up a recalibration between two frames
+        Ptr<const LoadedCalibration> calibration = calibrations.current();
+        if (calibration->version != calibrationVersion)
+        {
+            calibrationVersion = calibration->version;
+            width = calibration->calib.imageSize.width;
+            height = calibration->calib.imageSize.height;
+            K = calibration->calib.cameraMatrix;
+            distCoeff = calibration->calib.distCoeffs;
+            undistorter = calibration->undistorter;
+            filter.reset();
+            if (s.birdsEye)
+                birdsEye = makePtr<BirdsEyeView>(birdsEyeArea, s.birdsEyeScale, s.birdsEyeRefreshAngle,
+                                                 s.birdsEyeRefreshShift);
+
+            cout << "Image width = " << width << endl;
+            cout << "Image height = " << height << endl;
+            cout << "k = " << K << endl;
+            cout << "distCoeff = " << distCoeff << endl;
+        }
+
+        PoseTelemetry record = PoseTelemetry();
+        record.timestampUs = TelemetryPublisher::nowUs();
+        record.frame = frameIndex++;
 
         //! [find_pattern]
         vector<Point2f> pointBuf;
 
-        if (!s.inputCapture.isOpened())
+        if (!s.isLive())
         {
             cerr << "Camera is not opened, exit now!" << endl;
             return;
         }
 
-        bool found;
+        // pose expected in this frame from the filtered trajectory
+        Vec3d predictedR, predictedT;
+        const double dt = lastTimestampUs < 0 ? 0 : (record.timestampUs - lastTimestampUs) * 1e-6;
+        lastTimestampUs = record.timestampUs;
+        const bool predicted = s.poseFilter && filter.predict(dt, predictedR, predictedT);
 
-        int chessBoardFlags = CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_NORMALIZE_IMAGE | CALIB_CB_FAST_CHECK;
+        // look for the board where the prediction puts it before searching the whole frame
+        Rect searchRegion;
+        if (predicted)
+        {
+            vector<Point2f> predictedCorners;
+            projectPoints(objectPoints, predictedR, predictedT, K, distCoeff, predictedCorners);
+            Rect box = boundingRect(predictedCorners);
+            searchRegion = Rect(box.x - s.poseRegionMargin, box.y - s.poseRegionMargin,
+                                box.width + 2 * s.poseRegionMargin, box.height + 2 * s.poseRegionMargin)
+                           & Rect(Point(0, 0), view.size());
+        }
 
-        switch (s.calibrationPattern) // Find feature points on the input format
+        auto findPattern = [&](const Mat& image, vector<Point2f>& corners) -> bool
         {
-        case Settings::CHESSBOARD:
-            found = findChessboardCorners(view, s.boardSize, pointBuf, chessBoardFlags);
-            break;
-        case Settings::CIRCLES_GRID:
-            found = findCirclesGrid(view, s.boardSize, pointBuf);
-            break;
-        case Settings::ASYMMETRIC_CIRCLES_GRID:
-            found = findCirclesGrid(view, s.boardSize, pointBuf, CALIB_CB_ASYMMETRIC_GRID);
-            break;
-        default:
-            found = false;
-            break;
+            switch (s.calibrationPattern) // Find feature points on the input format
+            {
+            case Settings::CHESSBOARD:
+                return chessboard->detect(image, corners);
+            case Settings::CIRCLES_GRID:
+            case Settings::ASYMMETRIC_CIRCLES_GRID:
+                return circles.detect(image, corners);
+            default:
+                return false;
+            }
+        };
+
+        bool found = false;
+        if (!searchRegion.empty() && searchRegion.area() < view.size().area())
+        {
+            found = findPattern(view(searchRegion), pointBuf);
+            if (found)
+                for (Point2f& p : pointBuf)
+                    p += Point2f((float)searchRegion.x, (float)searchRegion.y);
+        }
+        if (!found)
+        {
+            pointBuf.clear();
+            found = findPattern(view, pointBuf);
         }
         //! [find_pattern]
-        //! [pattern_found]
-        if (found)                // If done with success,
+
+        // Only the overlays and measurements around the board need undistorted pixels;
+        // without a region the whole frame is undistorted.
+        vector<Rect> regions;
+        if (s.poseRegion == Settings::REGION_BOARD && found)
+            regions.push_back(undistorter->boardRegion(pointBuf, s.poseRegionMargin));
+        else if (s.poseRegion == Settings::REGION_SELECTED)
+            regions = selectedRegions;
+        if (regions.empty())
         {
-            // improve the found corners' coordinate accuracy for chessboard
-            if (s.calibrationPattern == Settings::CHESSBOARD)
+            undistortedView.create(view.size(), view.type());
+            undistorter->undistort(view, undistortedView, Rect(Point(0, 0), view.size()));
+        }
+        else
+        {
+            view.copyTo(undistortedView);
+            for (const Rect& r : regions)
             {
-                Mat viewGray;
-                cvtColor(view, viewGray, COLOR_BGR2GRAY);
-                cornerSubPix(viewGray, pointBuf, Size(11, 11),
-                    Size(-1, -1), TermCriteria(TermCriteria::EPS + TermCriteria::COUNT, 30, 0.0001));
+                undistorter->undistort(view, undistortedView, r);
+                rectangle(undistortedView, r, Scalar(0, 255, 255), 1);
             }
+        }
 
+        //! [pattern_found]
+        if (found)                // If done with success,
+        {
             imagePoints.swap(pointBuf);
 
             Mat rotVec, t, R;
 
-            solvePnP(objectPoints, imagePoints, K, distCoeff, rotVec, t);
+            // the prediction is a good starting point for the iterative solver
+            if (predicted)
+            {
+                rotVec = Mat(predictedR);
+                t = Mat(predictedT);
+            }
+            solvePnP(objectPoints, imagePoints, K, distCoeff, rotVec, t, predicted);
             Rodrigues(rotVec, R);
 
             vector<Point2f> reprojImagePoints;
@@ -476,6 +955,24 @@ void computeChessboardPose(Settings& s) {
             rmse = std::sqrt(err * err / n);
             cout << "RMSE of back-proj " << rmse << endl;
 
+            // report and draw the smoothed pose
+            if (s.poseFilter)
+            {
+                Vec3d filteredR, filteredT;
+                filter.correct(Vec3d(rotVec.ptr<double>()), Vec3d(t.ptr<double>()), filteredR, filteredT);
+                rotVec = Mat(filteredR);
+                t = Mat(filteredT);
+                Rodrigues(rotVec, R);
+            }
+
+            if (birdsEye)
+                birdsEye->update(Matx33d(K.ptr<double>()), distCoeff, Vec3d(rotVec.ptr<double>()), Vec3d(t.ptr<double>()));
+
+            record.found = 1;
+            record.rmse = rmse;
+            for (int i = 0; i < 3; i++)
+                record.translation[i] = t.at<double>(i);
+
             Mat P, Ext;
             hconcat(R, t, Ext);
             P = K * Ext;
@@ -524,20 +1021,19 @@ void computeChessboardPose(Settings& s) {
             pitch = 0;
             yaw = 0;
             
-            if (isRotationMatrix(R)) {
-                Mat euler = rot2euler(R);
-                roll = euler.at<double>(0, 0) * 100 / CV_PI;
-                pitch = euler.at<double>(1, 0) * 100 / CV_PI;
-                yaw = euler.at<double>(2, 0) * 100 / CV_PI;
+            Matx33d Rm(R);
+            if (isRotationMatrix(Rm)) {
+                Vec3d euler = rot2euler(Rm);
+                for (int i = 0; i < 3; i++)
+                    record.euler[i] = euler[i];
+                Vec3d deg = rad2deg(euler);
+                roll = deg[0];
+                pitch = deg[1];
+                yaw = deg[2];
             }
 
-            vector<Point3f> scene_axis_point;
             vector<Point2f> projected_axis_point;
-            scene_axis_point.push_back(Point3f(3 * s.squareSize, 0, 0)); //x
-            scene_axis_point.push_back(Point3f(0, 3 * s.squareSize, 0));//y
-            scene_axis_point.push_back(Point3f(0, 0, 3 * s.squareSize));//z
-
-            projectPoints(scene_axis_point, rotVec, t, K, Mat::zeros(1, 5, CV_64FC1), projected_axis_point);
+            projectPoints(board->axisPoints, rotVec, t, K, Mat::zeros(1, 5, CV_64FC1), projected_axis_point);
 
             arrowedLine(undistortedView, Point2f(o(0), o(1)), projected_axis_point[0], Scalar(255, 0, 0), 2);
             arrowedLine(undistortedView, Point2f(o(0), o(1)), projected_axis_point[1], Scalar(0, 255, 0), 2);
@@ -558,10 +1054,40 @@ void computeChessboardPose(Settings& s) {
             putText(undistortedView, pitch_str, cv::Point(width - 200, 50), cv::FONT_HERSHEY_DUPLEX, 0.5, Scalar(0, 255, 0), 1);
             putText(undistortedView, yaw_str, cv::Point(width - 200, 75), cv::FONT_HERSHEY_DUPLEX, 0.5, Scalar(0, 0, 255), 1);
         }
+        else if (predicted && filter.coast())
+        {
+            // keep reporting through a short dropout
+            record.found = 2;
+            Vec3d euler = rot2euler(rodrigues(predictedR));
+            for (int i = 0; i < 3; i++)
+            {
+                record.euler[i] = euler[i];
+                record.translation[i] = predictedT[i];
+            }
+            putText(undistortedView, "predicted", cv::Point(width - 200, 25), cv::FONT_HERSHEY_DUPLEX, 0.5, Scalar(0, 255, 255), 1);
+        }
+
+        if (telemetry)
+            telemetry->publish(record);
+
+        // the last maps stay in use while the board is out of view
+        if (birdsEye && birdsEye->ready() && !view.empty())
+        {
+            birdsEye->render(view, birdsEyeFrame);
+            imshow("Board Plane", birdsEyeFrame);
+            if (!s.birdsEyeOutput.empty() && !birdsEyeWriter.isOpened())
+            {
+                birdsEyeWriter.open(s.birdsEyeOutput, VideoWriter::fourcc('M', 'J', 'P', 'G'), 30, birdsEye->size());
+                if (!birdsEyeWriter.isOpened())
+                    cerr << "Could not create " << s.birdsEyeOutput << endl;
+            }
+            if (birdsEyeWriter.isOpened())
+                birdsEyeWriter << birdsEyeFrame;
+        }
 
         copyTo(mask, view, mask);
         imshow(winName, undistortedView);
-        char key = (char)waitKey(s.inputCapture.isOpened() ? 50 : s.delay);
+        char key = (char)s.waitInput(s.inputCapture.isOpened() ? 50 : s.delay);
 
 
         if (key == 27)
@@ -572,10 +1098,17 @@ void computeChessboardPose(Settings& s) {
         {
             s.showUndistorsed = !s.showUndistorsed;
         }
-        else if (s.inputCapture.isOpened() && key == 'g')
+        else if (s.isLive() && key == 'g')
         {
             imagePoints.clear();
         }
+        else if (key == 'r' && s.poseRegion == Settings::REGION_SELECTED)
+        {
+            // an empty selection goes back to the full frame
+            selectedRegions.clear();
+            selectROIs(winName, raw_view, selectedRegions);
+            s.hookMouse(winName, onMouse, &clickedPoints);
+        }
         else if (key == CAPTURE_CALIBRATION)
         {
             clicked = true;
@@ -604,7 +1137,13 @@ int main(int argc, char* argv[])
           "{@settings      |default.xml| input setting file            }"
           "{d              |           | actual distance between top-left and top-right corners of "
           "the calibration grid }"
-          "{winSize        | 11        | Half of search window for cornerSubPix }";
+          "{winSize        | 11        | Half of search window for cornerSubPix }"
+          "{undistort      |           | undistort this image directory or video with a saved calibration and exit }"
+          "{calib          | xml/out_calibration.xml | calibration file used by -undistort }"
+          "{o output       | undistorted | output directory (images) or video file of -undistort }"
+          "{threads        | 0         | worker threads of -undistort (0 = one per core) }"
+          "{grid           | 0         | -undistort with a sparse fixed-point grid of this node spacing instead of full maps }"
+          "{grid_file      |           | grid file of -undistort: loaded if it exists, otherwise built and saved there }";
     CommandLineParser parser(argc, argv, keys);
     parser.about("This is a camera calibration sample.\n"
                  "Usage: camera_calibration [configuration_file -- default ./default.xml]\n"
@@ -620,6 +1159,12 @@ int main(int argc, char* argv[])
         return 0;
     }
 
+    if (parser.has("undistort")) {
+        return run_batch_undistort(parser.get<string>("calib"), parser.get<string>("undistort"),
+                                   parser.get<string>("output"), parser.get<int>("threads"),
+                                   parser.get<int>("grid"), parser.get<string>("grid_file"));
+    }
+
     //! [file_read]
     Settings s;
     const string inputSettingsFile = parser.get<string>(0);
@@ -653,9 +1198,13 @@ int main(int argc, char* argv[])
     }
 
     vector<vector<Point2f>> imagePoints;
+    vector<vector<Point3f>> objectPoints;   // per view, only filled for partial boards
+    CoverageMap coverage;
+    Ptr<const BoardModel> board = s.boardModel();
     Mat cameraMatrix, distCoeffs;
     Size imageSize;
-    int mode = s.inputType == Settings::IMAGE_LIST ? CAPTURING : DETECTION;
+    // sampled video frames are candidates like the images of a list, no need to press 'g'
+    int mode = s.inputType == Settings::IMAGE_LIST || s.videoSampler ? CAPTURING : DETECTION;
     clock_t prevTimestamp = 0;
     const Scalar RED(0,0,255), GREEN(0,255,0);
     const char ESC_KEY = 27;
@@ -664,22 +1213,171 @@ int main(int argc, char* argv[])
     mask = Mat(n.size(), n.type(), Scalar(0, 0, 0));
     const char winName[] = "Image View";
     namedWindow(winName, WINDOW_KEEPRATIO);
-    setMouseCallback(winName, onMouse, 0 );
+    s.hookMouse(winName, onMouse, 0);
 
     computeChessboardPose(s);
 
+    int chessBoardFlags = CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_NORMALIZE_IMAGE;
+
+    if(!s.useFisheye) {
+        // fast check erroneously fails with high distortions like fisheye
+        chessBoardFlags |= CALIB_CB_FAST_CHECK;
+    }
+    // corners come back refined, and detect() may run on the pipeline's threads concurrently
+    Ptr<ChessboardDetector> chessboard = ChessboardDetector::create(s.detectorBackend, s.boardSize, chessBoardFlags,
+                                                                    winSize, s.detectorBudgetMs);
+    CircleGridDetector circles(s.boardSize, s.calibrationPattern == Settings::ASYMMETRIC_CIRCLES_GRID, s.blobParams,
+                               s.blobAdaptiveRange, s.blobReuseRoi);
+
+    DetectionCache cache;
+    if (s.inputType == Settings::IMAGE_LIST && !s.detectionCacheFile.empty() && !s.partialDetector)
+    {
+        cache = DetectionCache(s.detectionCacheFile,
+                               board_signature(s.boardSize, s.calibrationPattern, winSize,
+                                               chessBoardFlags | (s.detectorBackend << 16), s.flipVertical,
+                                               { s.blobParams.minThreshold, s.blobParams.maxThreshold,
+                                                 s.blobParams.thresholdStep, (float)s.blobAdaptiveRange,
+                                                 (float)s.blobParams.minRepeatability, s.blobParams.minDistBetweenBlobs,
+                                                 (float)s.blobColor, s.blobParams.minArea, s.blobParams.maxArea,
+                                                 s.blobMinCircularity, s.blobMinInertia, s.blobMinConvexity,
+                                                 (float)s.minSharpness, (float)s.maxClipped,
+                                                 (float)s.detectorBudgetMs }));
+
+        // Only the solver settings changed since the last run: skip decoding and detection
+        if (loadCachedDetections(s, cache, board->planarCorners, imagePoints, coverage, imageSize))
+        {
+            cout << "Using " << imagePoints.size() << " cached detections" << endl;
+            if (runCalibrationAndSave(s, imageSize, cameraMatrix, distCoeffs, imagePoints, objectPoints, grid_width,
+                                      release_object))
+            {
+                mode = CALIBRATED;
+                s.atImageList = s.imageList.size();
+            }
+            else
+                imagePoints.clear();
+        }
+    }
+
+    // Frames that would only give poor corners are not searched; consecutive images of a list
+    // are unrelated, so they skip the motion test
+    QualityGate gate(s.minSharpness, s.maxClipped, s.inputType == Settings::IMAGE_LIST ? 0 : s.maxMotion);
+
+    // Capture stage: the next frame of the input, flipped as configured, and its quality
+    auto grabFrame = [&](DetectedFrame& frame)
+    {
+        frame.view = s.nextImage();
+        gate.check(frame.view, frame.quality);
+        if (frame.view.empty())
+            return;
+        if( s.flipVertical )    flip( frame.view, frame.view, 0 );
+        //flip(view, view, 1); // mirror effect
+        if (s.inputType == Settings::IMAGE_LIST)
+            frame.imagePath = s.imageList[s.atImageList - 1];
+    };
+
+    // Undistorted display: the render loop below publishes the maps of the calibration, built
+    // once, and the detection stage remaps the frames with them off the render thread
+    mutex undistorterLock;
+    Ptr<const ViewUndistorter> sharedUndistorter, undistorter;
+
+    // Detection stage: cached corners, or the pattern search and refinement
+    mutex cacheLock;
+    auto detectFrame = [&](DetectedFrame& frame)
+    {
+        const Mat& view = frame.view;
+        vector<Point2f>& pointBuf = frame.corners;
+        Size size = view.size();
+        {
+            Ptr<const ViewUndistorter> maps;
+            {
+                lock_guard<mutex> guard(undistorterLock);
+                maps = sharedUndistorter;
+            }
+            if (maps && maps->viewSize() == size)
+            {
+                frame.undistorted = s.framePool->get(size, view.type());
+                maps->undistort(view, frame.undistorted);
+                frame.undistorter = maps;
+            }
+        }
+        bool cached;
+        {
+            lock_guard<mutex> guard(cacheLock);
+            cached = cache.lookup(frame.imagePath, size, pointBuf, frame.found);
+        }
+        if (cached)
+            return;
+
+        bool found = false;
+        if (frame.quality.reason)
+        {
+            // remembered as not found, the signature covers the gate thresholds
+            if (!frame.imagePath.empty())
+            {
+                lock_guard<mutex> guard(cacheLock);
+                cache.store(frame.imagePath, size, pointBuf, false);
+            }
+            frame.found = false;
+            return;
+        }
+        if (s.partialDetector)
+        {
+            found = s.partialDetector->detect(view, frame.boards);
+        }
+        else
+        {
+            switch( s.calibrationPattern ) // Find feature points on the input format
+            {
+            case Settings::CHESSBOARD:
+                found = chessboard->detect(view, pointBuf);
+                break;
+            case Settings::CIRCLES_GRID:
+            case Settings::ASYMMETRIC_CIRCLES_GRID:
+                found = circles.detect(view, pointBuf);
+                break;
+            default:
+                found = false;
+                break;
+            }
+
+            if (!frame.imagePath.empty())
+            {
+                lock_guard<mutex> guard(cacheLock);
+                cache.store(frame.imagePath, size, pointBuf, found);
+            }
+        }
+        frame.found = found;
+    };
+
+    // Capture and detection run on their own threads and overlap with the rendering below.
+    // Recorded and replayed sessions stay on one thread so their key events line up with the frames.
+    Ptr<CapturePipeline> pipeline;
+    if (s.pipelineThreads > 0 && !s.recorder && !s.replayer)
+        pipeline = makePtr<CapturePipeline>(grabFrame, detectFrame, s.pipelineThreads);
+
     //! [get_input]
     for(;;)
     {
-        Mat view;
         bool blinkOutput = false;
 
-        view = s.nextImage();
+        DetectedFrame frame;
+        frame.found = false;
+        if (pipeline)
+            frame = pipeline->next();
+        else
+        {
+            grabFrame(frame);
+            if (!frame.view.empty())
+                detectFrame(frame);
+        }
+        Mat view = frame.view;
 
         //-----  If no more image, or got enough, then stop calibration and show result -------------
-        if( mode == CAPTURING && imagePoints.size() >= (size_t)s.nrFrames )
+        // enough coverage ends the capture before nrFrames views
+        if( mode == CAPTURING && (imagePoints.size() >= (size_t)s.nrFrames ||
+            (s.coverageTarget > 0 && coverage.enough(s.coverageTarget, s.minPoseBins))) )
         {
-          if(runCalibrationAndSave(s, imageSize,  cameraMatrix, distCoeffs, imagePoints, grid_width,
+          if(runCalibrationAndSave(s, imageSize,  cameraMatrix, distCoeffs, imagePoints, objectPoints, grid_width,
                                    release_object))
               mode = CALIBRATED;
           else
@@ -689,66 +1387,79 @@ int main(int argc, char* argv[])
         {
             // if calibration threshold was not reached yet, calibrate now
             if( mode != CALIBRATED && !imagePoints.empty() )
-                runCalibrationAndSave(s, imageSize,  cameraMatrix, distCoeffs, imagePoints, grid_width,
+                runCalibrationAndSave(s, imageSize,  cameraMatrix, distCoeffs, imagePoints, objectPoints, grid_width,
                                       release_object);
             break;
         }
         //! [get_input]
 
         imageSize = view.size();  // Format input image.
-        if( s.flipVertical )    flip( view, view, 0 );
-        //flip(view, view, 1); // mirror effect
-
-        Mat raw_view = view.clone();
-
-        //! [find_pattern]
-        vector<Point2f> pointBuf;
+        if (coverage.imageSize() != imageSize)
+            coverage = CoverageMap(imageSize);
 
-        bool found;
-
-        int chessBoardFlags = CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_NORMALIZE_IMAGE;
+        Mat raw_view = s.framePool->get(view.size(), view.type());
+        view.copyTo(raw_view);
 
-        if(!s.useFisheye) {
-            // fast check erroneously fails with high distortions like fisheye
-            chessBoardFlags |= CALIB_CB_FAST_CHECK;
+        //------------------------- Video capture  output  undistorted ------------------------------
+        //! [output_undistorted]
+        // shown undistorted: the frame comes remapped from the detection stage (or is remapped here
+        // when it was queued before the maps), and the corners, only drawn from here on, move alike
+        const bool showUndistorted = mode == CALIBRATED && s.showUndistorsed;
+        if (showUndistorted && (!undistorter || !undistorter->fits(s.useFisheye, cameraMatrix, distCoeffs, view.size())))
+            undistorter = makePtr<ViewUndistorter>(s.useFisheye, cameraMatrix, distCoeffs, imageSize, view.size());
+        {
+            lock_guard<mutex> guard(undistorterLock);
+            sharedUndistorter = showUndistorted ? undistorter : Ptr<const ViewUndistorter>();
         }
-
-        switch( s.calibrationPattern ) // Find feature points on the input format
+        if (showUndistorted)
         {
-        case Settings::CHESSBOARD:
-            found = findChessboardCorners( view, s.boardSize, pointBuf, chessBoardFlags);
-            break;
-        case Settings::CIRCLES_GRID:
-            found = findCirclesGrid( view, s.boardSize, pointBuf );
-            break;
-        case Settings::ASYMMETRIC_CIRCLES_GRID:
-            found = findCirclesGrid( view, s.boardSize, pointBuf, CALIB_CB_ASYMMETRIC_GRID );
-            break;
-        default:
-            found = false;
-            break;
+            if (frame.undistorter != undistorter)
+            {
+                frame.undistorted = s.framePool->get(view.size(), view.type());
+                undistorter->undistort(view, frame.undistorted);
+            }
+            view = frame.undistorted;
+            undistorter->undistortPoints(frame.corners, frame.corners);
+            for (BoardView& b : frame.boards)
+                undistorter->undistortPoints(b.imagePoints, b.imagePoints);
         }
+        //! [output_undistorted]
+
+        //! [find_pattern]
+        const bool found = frame.found;
+        const vector<Point2f>& pointBuf = frame.corners;
+        const vector<BoardView>& boardViews = frame.boards;
         //! [find_pattern]
         //! [pattern_found]
         if ( found)                // If done with success,
         {
-              // improve the found corners' coordinate accuracy for chessboard
-                if( s.calibrationPattern == Settings::CHESSBOARD)
-                {
-                    Mat viewGray;
-                    cvtColor(view, viewGray, COLOR_BGR2GRAY);
-                    cornerSubPix( viewGray, pointBuf, Size(winSize,winSize),
-                        Size(-1,-1), TermCriteria( TermCriteria::EPS+TermCriteria::COUNT, 30, 0.0001 ));
-                }
-
                 // Draw the corners.
-                drawChessboardCorners(view, s.boardSize, Mat(pointBuf), found);
+                if (boardViews.empty())
+                    drawChessboardCorners(view, s.boardSize, Mat(pointBuf), found);
+                for (const BoardView& b : boardViews)
+                    for (const Point2f& p : b.imagePoints)
+                        circle(view, p, 3, GREEN, 1);
                 if( mode == CAPTURING &&  // For camera only take new samples after delay time
-                    (!s.inputCapture.isOpened() || /*clock() - prevTimestamp > s.delay*1e-3*CLOCKS_PER_SEC*/ clicked) )
+                    (!s.isLive() || /*clock() - prevTimestamp > s.delay*1e-3*CLOCKS_PER_SEC*/ clicked) )
                 {
-                    imagePoints.push_back(pointBuf);
+                    // every board of the frame is a view of its own
+                    if (boardViews.empty())
+                    {
+                        imagePoints.push_back(pointBuf);
+                        coverage.addView(pointBuf, board->planarCorners);
+                    }
+                    for (const BoardView& b : boardViews)
+                    {
+                        imagePoints.push_back(b.imagePoints);
+                        objectPoints.push_back(b.objectPoints);
+
+                        vector<Point2f> plane;
+                        for (const Point3f& p : b.objectPoints)
+                            plane.push_back(Point2f(p.x, p.y));
+                        coverage.addView(b.imagePoints, plane);
+                    }
                     prevTimestamp = clock();
-                    blinkOutput = s.inputCapture.isOpened();
+                    blinkOutput = s.isLive();
 
                     if (s.inputType == Settings::InputType::CAMERA || s.inputType == Settings::InputType::VIDEO_FILE) {
                         save_img_on_file(s.imgOutputDirectory, raw_view, "raw_");
@@ -772,29 +1483,23 @@ int main(int argc, char* argv[])
                 msg = format( "%d/%d Undist", (int)imagePoints.size(), s.nrFrames );
             else
                 msg = format( "%d/%d", (int)imagePoints.size(), s.nrFrames );
+            if (s.coverageTarget > 0)
+                msg += format(" %d%% %d tilts", cvRound(coverage.cellCoverage() * 100), coverage.poseBins());
+            if (s.showCoverage)
+                coverage.draw(view);
         }
 
         putText( view, msg, textOrigin, 1, 1, mode == CALIBRATED ?  GREEN : RED);
+        if (frame.quality.reason)
+        {
+            putText(view, format("skipped: %s", frame.quality.reason), Point(10, view.rows - 2*baseLine - 10), 1, 1, RED);
+            if (s.inputType == Settings::IMAGE_LIST)
+                cout << "Skipped " << frame.imagePath << ": " << frame.quality.reason << endl;
+        }
 
         if( blinkOutput )
             bitwise_not(view, view);
         //! [output_text]
-        //------------------------- Video capture  output  undistorted ------------------------------
-        //! [output_undistorted]
-        if( mode == CALIBRATED && s.showUndistorsed )
-        {
-            Mat temp = view.clone();
-            if (s.useFisheye)
-            {
-                Mat newCamMat;
-                fisheye::estimateNewCameraMatrixForUndistortRectify(cameraMatrix, distCoeffs, imageSize,
-                                                                    Matx33d::eye(), newCamMat, 1);
-                cv::fisheye::undistortImage(temp, view, cameraMatrix, distCoeffs, newCamMat);
-            }
-            else
-              undistort(temp, view, cameraMatrix, distCoeffs);
-        }
-        //! [output_undistorted]
         //------------------------------ Show image and check for input commands -------------------
         //! [await_input]
         /*Mat binaryMask = Mat(mask.size(), mask.type());
@@ -815,7 +1520,7 @@ int main(int argc, char* argv[])
         }*/
         copyTo(mask, view, mask);
         imshow(winName, view);
-        char key = (char)waitKey(s.inputCapture.isOpened() ? 50 : s.delay);
+        char key = (char)s.waitInput(s.inputCapture.isOpened() ? 50 : s.delay);
 
 
         if (key == ESC_KEY) 
@@ -826,10 +1531,12 @@ int main(int argc, char* argv[])
         {
             s.showUndistorsed = !s.showUndistorsed;
         }
-        else if( s.inputCapture.isOpened() && key == 'g' )
+        else if( s.isLive() && key == 'g' )
         {
             mode = CAPTURING;
             imagePoints.clear();
+            objectPoints.clear();
+            coverage.clear();
         }
         else if (key == CAPTURE_CALIBRATION)
         {
@@ -850,33 +1557,32 @@ int main(int argc, char* argv[])
         //! [await_input]
     }
 
+    pipeline.release();
+    cache.save();
+
     // -----------------------Show the undistorted image for the image list ------------------------
     //! [show_results]
     if( s.inputType == Settings::IMAGE_LIST && s.showUndistorsed && !cameraMatrix.empty())
     {
         Mat view, rview, map1, map2;
+        Size mapSize;
 
-        if (s.useFisheye)
-        {
-            Mat newCamMat;
-            fisheye::estimateNewCameraMatrixForUndistortRectify(cameraMatrix, distCoeffs, imageSize,
-                                                                Matx33d::eye(), newCamMat, 1);
-            fisheye::initUndistortRectifyMap(cameraMatrix, distCoeffs, Matx33d::eye(), newCamMat, imageSize,
-                                             CV_16SC2, map1, map2);
-        }
-        else
-        {
-            initUndistortRectifyMap(
-                cameraMatrix, distCoeffs, Mat(),
-                getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, imageSize, 1, imageSize, 0), imageSize,
-                CV_16SC2, map1, map2);
-        }
+        // Reuse the frames kept by the capture loop, otherwise decode (possibly reduced) ahead again
+        Ptr<ImagePrefetcher> loader = s.imageLoader;
+        if (!loader || !s.keepDecoded || s.previewReduction > 1)
+            loader = makePtr<ImagePrefetcher>(s.imageList, reduced_imread_flag(s.previewReduction),
+                                              std::max(s.prefetchThreads, 1), (size_t)std::max(s.prefetchDepth, 1));
 
         for(size_t i = 0; i < s.imageList.size(); i++ )
         {
-            view = imread(s.imageList[i], IMREAD_COLOR);
+            view = loader->get(i);
             if(view.empty())
                 continue;
+            if (view.size() != mapSize)
+            {
+                mapSize = view.size();
+                buildUndistortMaps(s.useFisheye, cameraMatrix, distCoeffs, imageSize, mapSize, map1, map2);
+            }
             remap(view, rview, map1, map2, INTER_LINEAR);
             imshow(winName, rview);
             char c = (char)waitKey();
@@ -894,7 +1600,7 @@ static double computeReprojectionErrors( const vector<vector<Point3f> >& objectP
                                          const vector<vector<Point2f> >& imagePoints,
                                          const vector<Mat>& rvecs, const vector<Mat>& tvecs,
                                          const Mat& cameraMatrix , const Mat& distCoeffs,
-                                         vector<float>& perViewErrors, bool fisheye)
+                                         vector<float>& perViewErrors, bool fisheye, bool verbose = true)
 {
     vector<Point2f> imagePoints2;
     size_t totalPoints = 0;
@@ -916,7 +1622,8 @@ static double computeReprojectionErrors( const vector<vector<Point3f> >& objectP
 
         size_t n = objectPoints[i].size();
         perViewErrors[i] = (float) std::sqrt(err*err/n);
-        cout << "error" << i << ":" << perViewErrors[i] << endl;
+        if (verbose)
+            cout << "error" << i << ":" << perViewErrors[i] << endl;
         totalErr        += err*err;
         totalPoints     += n;
     }
@@ -949,36 +1656,42 @@ static double computeReprojectionErrors( const vector<vector<Point3f> >& objectP
     }
 }*/
 //! [board_corners]
-static bool runCalibration( Settings& s, Size& imageSize, Mat& cameraMatrix, Mat& distCoeffs,
-                            vector<vector<Point2f> > imagePoints, vector<Mat>& rvecs, vector<Mat>& tvecs,
-                            vector<float>& reprojErrs,  double& totalAvgErr, vector<Point3f>& newObjPoints,
-                            float grid_width, bool release_object)
+static bool runCalibration( Settings& s, const CalibrationModel& model, Size& imageSize, Mat& cameraMatrix,
+                            Mat& distCoeffs, const vector<vector<Point2f> >& imagePoints,
+                            const vector<vector<Point3f> >& viewObjectPoints,
+                            vector<Mat>& rvecs, vector<Mat>& tvecs, vector<float>& reprojErrs,
+                            double& totalAvgErr, vector<Point3f>& newObjPoints, Mat& stdDeviations,
+                            float grid_width, bool release_object, bool verbose = true)
 {
     //! [fixed_aspect]
     cameraMatrix = Mat::eye(3, 3, CV_64F);
-    if( !s.useFisheye && s.flag & CALIB_FIX_ASPECT_RATIO )
+    if( !model.useFisheye && model.flag & CALIB_FIX_ASPECT_RATIO )
         cameraMatrix.at<double>(0,0) = s.aspectRatio;
     //! [fixed_aspect]
-    if (s.useFisheye) {
+    if (model.useFisheye) {
         distCoeffs = Mat::zeros(4, 1, CV_64F);
     } else {
         distCoeffs = Mat::zeros(8, 1, CV_64F);
     }
 
-    vector<vector<Point3f> > objectPoints(1);
-    calcBoardCornerPositions(s.boardSize, s.squareSize, objectPoints[0], s.calibrationPattern);
-    objectPoints[0][s.boardSize.width - 1].x = objectPoints[0][0].x + grid_width;
-    newObjPoints = objectPoints[0];
+    Ptr<const BoardModel> board = s.boardModel(grid_width);
+    newObjPoints = board->corners;
 
-    objectPoints.resize(imagePoints.size(),objectPoints[0]);
+    // Partial views carry their own board points (empty = every view sees the whole board).
+    // The board can only be released when all views share the same points.
+    const bool partial = !viewObjectPoints.empty();
+    vector<vector<Point3f> > objectPoints = partial ? viewObjectPoints
+                                                    : vector<vector<Point3f> >(imagePoints.size(), board->corners);
+    if (partial)
+        release_object = false;
 
     //Find intrinsic and extrinsic camera parameters
     double rms;
 
-    if (s.useFisheye) {
+    if (model.useFisheye) {
         Mat _rvecs, _tvecs;
         rms = fisheye::calibrate(objectPoints, imagePoints, imageSize, cameraMatrix, distCoeffs, _rvecs,
-                                 _tvecs, s.flag);
+                                 _tvecs, model.flag);
 
         rvecs.reserve(_rvecs.rows);
         tvecs.reserve(_tvecs.rows);
@@ -990,12 +1703,23 @@ static bool runCalibration( Settings& s, Size& imageSize, Mat& cameraMatrix, Mat
         int iFixedPoint = -1;
         if (release_object)
             iFixedPoint = s.boardSize.width - 1;
-        rms = calibrateCameraRO(objectPoints, imagePoints, imageSize, iFixedPoint,
-                                cameraMatrix, distCoeffs, rvecs, tvecs, newObjPoints,
-                                s.flag | CALIB_USE_LU);
+        // the sparse solver keeps the board fixed, releasing it needs the dense one
+        if (s.solver == Settings::SOLVER_SPARSE && !release_object)
+            rms = calibrateCameraSparse(objectPoints, imagePoints, imageSize, cameraMatrix, distCoeffs,
+                                        rvecs, tvecs, stdDeviations, model.flag);
+        else
+        {
+            if (s.solver == Settings::SOLVER_SPARSE && verbose)
+                cout << "Releasing the board needs the dense solver" << endl;
+            Mat stdDeviationsExtrinsics, stdDeviationsObjPoints, perViewErrors;
+            rms = calibrateCameraRO(objectPoints, imagePoints, imageSize, iFixedPoint,
+                                    cameraMatrix, distCoeffs, rvecs, tvecs, newObjPoints,
+                                    stdDeviations, stdDeviationsExtrinsics, stdDeviationsObjPoints,
+                                    perViewErrors, model.flag | CALIB_USE_LU);
+        }
     }
 
-    if (release_object) {
+    if (release_object && verbose) {
         cout << "New board corners: " << endl;
         cout << newObjPoints[0] << endl;
         cout << newObjPoints[s.boardSize.width - 1] << endl;
@@ -1003,23 +1727,29 @@ static bool runCalibration( Settings& s, Size& imageSize, Mat& cameraMatrix, Mat
         cout << newObjPoints.back() << endl;
     }
 
-    cout << "Re-projection error reported by calibrateCamera: "<< rms << endl;
+    if (verbose)
+        cout << "Re-projection error reported by calibrateCamera: "<< rms << endl;
 
     bool ok = checkRange(cameraMatrix) && checkRange(distCoeffs);
 
-    objectPoints.clear();
-    objectPoints.resize(imagePoints.size(), newObjPoints);
+    if (!partial)
+    {
+        objectPoints.clear();
+        objectPoints.resize(imagePoints.size(), newObjPoints);
+    }
     totalAvgErr = computeReprojectionErrors(objectPoints, imagePoints, rvecs, tvecs, cameraMatrix,
-                                            distCoeffs, reprojErrs, s.useFisheye);
+                                            distCoeffs, reprojErrs, model.useFisheye, verbose);
 
     return ok;
 }
 
 // Print camera parameters to the output file
-static void saveCameraParams( Settings& s, Size& imageSize, Mat& cameraMatrix, Mat& distCoeffs,
+static void saveCameraParams( Settings& s, const CalibrationModel& model, Size& imageSize,
+                              Mat& cameraMatrix, Mat& distCoeffs,
                               const vector<Mat>& rvecs, const vector<Mat>& tvecs,
                               const vector<float>& reprojErrs, const vector<vector<Point2f> >& imagePoints,
-                              double totalAvgErr, const vector<Point3f>& newObjPoints )
+                              double totalAvgErr, const vector<Point3f>& newObjPoints,
+                              const Mat& stdDeviations, const Mat& bootstrapIntervals )
 {
     if (!cv::utils::fs::exists(s.xmlOutputDirectory))
     {
@@ -1043,46 +1773,59 @@ static void saveCameraParams( Settings& s, Size& imageSize, Mat& cameraMatrix, M
     fs << "board_height" << s.boardSize.height;
     fs << "square_size" << s.squareSize;
 
-    if( !s.useFisheye && s.flag & CALIB_FIX_ASPECT_RATIO )
+    if( !model.useFisheye && model.flag & CALIB_FIX_ASPECT_RATIO )
         fs << "fix_aspect_ratio" << s.aspectRatio;
 
-    if (s.flag)
+    if (model.flag)
     {
         std::stringstream flagsStringStream;
-        if (s.useFisheye)
+        if (model.useFisheye)
         {
             flagsStringStream << "flags:"
-                << (s.flag & fisheye::CALIB_FIX_SKEW ? " +fix_skew" : "")
-                << (s.flag & fisheye::CALIB_FIX_K1 ? " +fix_k1" : "")
-                << (s.flag & fisheye::CALIB_FIX_K2 ? " +fix_k2" : "")
-                << (s.flag & fisheye::CALIB_FIX_K3 ? " +fix_k3" : "")
-                << (s.flag & fisheye::CALIB_FIX_K4 ? " +fix_k4" : "")
-                << (s.flag & fisheye::CALIB_RECOMPUTE_EXTRINSIC ? " +recompute_extrinsic" : "");
+                << (model.flag & fisheye::CALIB_FIX_SKEW ? " +fix_skew" : "")
+                << (model.flag & fisheye::CALIB_FIX_K1 ? " +fix_k1" : "")
+                << (model.flag & fisheye::CALIB_FIX_K2 ? " +fix_k2" : "")
+                << (model.flag & fisheye::CALIB_FIX_K3 ? " +fix_k3" : "")
+                << (model.flag & fisheye::CALIB_FIX_K4 ? " +fix_k4" : "")
+                << (model.flag & fisheye::CALIB_RECOMPUTE_EXTRINSIC ? " +recompute_extrinsic" : "");
         }
         else
         {
             flagsStringStream << "flags:"
-                << (s.flag & CALIB_USE_INTRINSIC_GUESS ? " +use_intrinsic_guess" : "")
-                << (s.flag & CALIB_FIX_ASPECT_RATIO ? " +fix_aspectRatio" : "")
-                << (s.flag & CALIB_FIX_PRINCIPAL_POINT ? " +fix_principal_point" : "")
-                << (s.flag & CALIB_ZERO_TANGENT_DIST ? " +zero_tangent_dist" : "")
-                << (s.flag & CALIB_FIX_K1 ? " +fix_k1" : "")
-                << (s.flag & CALIB_FIX_K2 ? " +fix_k2" : "")
-                << (s.flag & CALIB_FIX_K3 ? " +fix_k3" : "")
-                << (s.flag & CALIB_FIX_K4 ? " +fix_k4" : "")
-                << (s.flag & CALIB_FIX_K5 ? " +fix_k5" : "");
+                << (model.flag & CALIB_USE_INTRINSIC_GUESS ? " +use_intrinsic_guess" : "")
+                << (model.flag & CALIB_FIX_ASPECT_RATIO ? " +fix_aspectRatio" : "")
+                << (model.flag & CALIB_FIX_PRINCIPAL_POINT ? " +fix_principal_point" : "")
+                << (model.flag & CALIB_ZERO_TANGENT_DIST ? " +zero_tangent_dist" : "")
+                << (model.flag & CALIB_FIX_K1 ? " +fix_k1" : "")
+                << (model.flag & CALIB_FIX_K2 ? " +fix_k2" : "")
+                << (model.flag & CALIB_FIX_K3 ? " +fix_k3" : "")
+                << (model.flag & CALIB_FIX_K4 ? " +fix_k4" : "")
+                << (model.flag & CALIB_FIX_K5 ? " +fix_k5" : "")
+                << (model.flag & CALIB_RATIONAL_MODEL ? " +rational_model" : "");
         }
         fs.writeComment(flagsStringStream.str());
     }
 
-    fs << "flags" << s.flag;
+    fs << "flags" << model.flag;
 
-    fs << "fisheye_model" << s.useFisheye;
+    fs << "fisheye_model" << model.useFisheye;
 
     fs << "camera_matrix" << cameraMatrix;
     fs << "distortion_coefficients" << distCoeffs;
 
     fs << "avg_reprojection_error" << totalAvgErr;
+
+    if (!stdDeviations.empty())
+    {
+        fs.writeComment("std deviations of fx, fy, cx, cy, k1, k2, p1, p2, k3, k4, k5, k6, s1, s2, s3, s4, tx, ty");
+        fs << "intrinsic_std_deviations" << stdDeviations;
+    }
+    if (!bootstrapIntervals.empty())
+    {
+        fs << "bootstrap_samples" << s.bootstrapSamples;
+        fs.writeComment("95% intervals of fx, fy, cx, cy and the distortion coefficients: lower, upper, std deviation");
+        fs << "bootstrap_confidence_intervals" << bootstrapIntervals;
+    }
     if (s.writeExtrinsics && !reprojErrs.empty())
         fs << "per_view_reprojection_errors" << Mat(reprojErrs);
 
@@ -1117,9 +1860,39 @@ static void saveCameraParams( Settings& s, Size& imageSize, Mat& cameraMatrix, M
         }
         fs.writeComment("a set of 6-tuples (rotation vector + translation vector) for each view");
         fs << "extrinsic_parameters" << bigmat;
+
+        vector<Vec3d> rotations(rvecs.size()), euler;
+        for (size_t i = 0; i < rvecs.size(); i++)
+        {
+            Mat r;
+            rvecs[i].reshape(1, 3).convertTo(r, CV_64F);
+            rotations[i] = Vec3d(r.at<double>(0), r.at<double>(1), r.at<double>(2));
+        }
+        rvecs2euler(rotations, euler);
+        Mat eulerMat((int)euler.size(), 3, CV_64F);
+        for (size_t i = 0; i < euler.size(); i++)
+        {
+            Vec3d deg = rad2deg(euler[i]);
+            for (int j = 0; j < 3; j++)
+                eulerMat.at<double>((int)i, j) = deg[j];
+        }
+        fs.writeComment("roll, pitch, yaw in degrees of each view (R = Rz * Ry * Rx)");
+        fs << "extrinsic_euler_angles" << eulerMat;
     }
 
-    if(s.writePoints && !imagePoints.empty() )
+    bool sameLength = true;
+    for (size_t i = 1; i < imagePoints.size(); i++)
+        sameLength = sameLength && imagePoints[i].size() == imagePoints[0].size();
+
+    if (s.writePoints && !imagePoints.empty() && !sameLength)
+    {
+        // partial boards: one row per view
+        fs << "image_points" << "[";
+        for (size_t i = 0; i < imagePoints.size(); i++)
+            fs << Mat(imagePoints[i]).reshape(2, 1);
+        fs << "]";
+    }
+    else if(s.writePoints && !imagePoints.empty() )
     {
         Mat imagePtMat((int)imagePoints.size(), (int)imagePoints[0].size(), CV_32FC2);
         for( size_t i = 0; i < imagePoints.size(); i++ )
@@ -1137,23 +1910,350 @@ static void saveCameraParams( Settings& s, Size& imageSize, Mat& cameraMatrix, M
     }
 }
 
+// The output of one calibration solve, kept around so that several models can be compared
+struct CalibrationResult
+{
+    CalibrationModel model;
+    bool ok;
+    Mat cameraMatrix, distCoeffs;
+    vector<Mat> rvecs, tvecs;
+    vector<float> reprojErrs;
+    double totalAvgErr;
+    double heldOutErr;          // RMS error on views left out of the solve, < 0 when not available
+    vector<Point3f> newObjPoints;
+    Mat stdDeviations;
+};
+
+// Views are split in at most this many folds to measure the error of a model on unseen views
+enum { MODEL_FOLDS = 5 };
+
+// Lens models tried when Calibrate_CompareModels is set. The pinhole variants start from the
+// Fix_K* choices of the settings file and free or fix the higher order radial terms.
+static vector<CalibrationModel> comparisonModels(const Settings& s)
+{
+    const int radialFlags = CALIB_FIX_K1 | CALIB_FIX_K2 | CALIB_FIX_K3 | CALIB_FIX_K4 | CALIB_FIX_K5 | CALIB_FIX_K6;
+    const int baseFlag = s.pinholeFlag & ~radialFlags;
+
+    vector<CalibrationModel> models;
+    models.push_back({ "pinhole", false, s.pinholeFlag });
+    models.push_back({ "pinhole_k1", false, baseFlag | (radialFlags & ~CALIB_FIX_K1) });
+    models.push_back({ "pinhole_k1_k2", false, baseFlag | CALIB_FIX_K3 | CALIB_FIX_K4 | CALIB_FIX_K5 | CALIB_FIX_K6 });
+    models.push_back({ "pinhole_k1_k2_k3", false, baseFlag | CALIB_FIX_K4 | CALIB_FIX_K5 | CALIB_FIX_K6 });
+    models.push_back({ "rational", false, baseFlag | CALIB_RATIONAL_MODEL });
+    models.push_back({ "fisheye", true, s.fisheyeFlag });
+    return models;
+}
+
+// Squared reprojection error of a view the intrinsics were not solved on: the view's pose is
+// found with solvePnP, so only the intrinsics are judged
+static double heldOutSquaredError(const CalibrationModel& model, const Mat& cameraMatrix, const Mat& distCoeffs,
+                                  const vector<Point3f>& objectPoints, const vector<Point2f>& imagePoints)
+{
+    Mat rvec, tvec;
+    vector<Point2f> projected;
+    if (model.useFisheye)
+    {
+        vector<Point2f> normalized;
+        fisheye::undistortPoints(imagePoints, normalized, cameraMatrix, distCoeffs);
+        solvePnP(objectPoints, normalized, Mat::eye(3, 3, CV_64F), noArray(), rvec, tvec);
+        fisheye::projectPoints(objectPoints, projected, rvec, tvec, cameraMatrix, distCoeffs);
+    }
+    else
+    {
+        solvePnP(objectPoints, imagePoints, cameraMatrix, distCoeffs, rvec, tvec);
+        projectPoints(objectPoints, rvec, tvec, cameraMatrix, distCoeffs, projected);
+    }
+    const double err = norm(imagePoints, projected, NORM_L2);
+    return err * err;
+}
+
+// Solve every model on the same views, and again on each fold's complement to measure its error
+// on the views of the fold. The models are nested (more coefficients always fit the training
+// views better), so they are ranked on that held-out error. All solves run in parallel.
+static vector<CalibrationResult> runModelComparison(Settings& s, Size imageSize,
+                                                    const vector<vector<Point2f> >& imagePoints,
+                                                    const vector<vector<Point3f> >& objectPoints,
+                                                    float grid_width, bool release_object, int& folds)
+{
+    const vector<CalibrationModel> models = comparisonModels(s);
+    vector<CalibrationResult> results(models.size());
+
+    // view i is held out in fold i % folds; too few views for cross-validation gives no folds
+    const int nViews = (int)imagePoints.size();
+    folds = nViews >= 2 * MODEL_FOLDS ? MODEL_FOLDS : nViews >= 4 ? nViews / 2 : 0;
+    vector<vector<double> > foldErr(models.size(), vector<double>(folds, -1));
+    vector<vector<size_t> > foldPoints(models.size(), vector<size_t>(folds, 0));
+
+    const int tasks = (int)models.size() * (folds + 1);
+    parallel_for_(Range(0, tasks), [&](const Range& range)
+    {
+        for (int t = range.start; t < range.end; t++)
+        {
+            const int m = t / (folds + 1), f = t % (folds + 1) - 1;
+            const CalibrationModel& model = models[m];
+            try
+            {
+                Size size = imageSize;
+                if (f < 0)
+                {
+                    CalibrationResult& r = results[m];
+                    r.model = model;
+                    r.totalAvgErr = 0;
+                    r.ok = runCalibration(s, r.model, size, r.cameraMatrix, r.distCoeffs, imagePoints, objectPoints,
+                                          r.rvecs, r.tvecs, r.reprojErrs, r.totalAvgErr, r.newObjPoints,
+                                          r.stdDeviations, grid_width, release_object, false);
+                    continue;
+                }
+
+                vector<vector<Point2f> > trainPoints;
+                vector<vector<Point3f> > trainObject;
+                for (int i = 0; i < nViews; i++)
+                    if (i % folds != f)
+                    {
+                        trainPoints.push_back(imagePoints[i]);
+                        if (!objectPoints.empty())
+                            trainObject.push_back(objectPoints[i]);
+                    }
+
+                Mat cameraMatrix, distCoeffs, stdDeviations;
+                vector<Mat> rvecs, tvecs;
+                vector<float> reprojErrs;
+                vector<Point3f> newObjPoints;
+                double totalAvgErr = 0;
+                if (!runCalibration(s, model, size, cameraMatrix, distCoeffs, trainPoints, trainObject, rvecs, tvecs,
+                                    reprojErrs, totalAvgErr, newObjPoints, stdDeviations, grid_width, release_object,
+                                    false))
+                    continue;
+
+                double err = 0;
+                size_t n = 0;
+                for (int i = f; i < nViews; i += folds)
+                {
+                    const vector<Point3f>& board = objectPoints.empty() ? newObjPoints : objectPoints[i];
+                    err += heldOutSquaredError(model, cameraMatrix, distCoeffs, board, imagePoints[i]);
+                    n += board.size();
+                }
+                foldErr[m][f] = err;
+                foldPoints[m][f] = n;
+            }
+            catch (const cv::Exception& ex)
+            {
+                // e.g. the fisheye solver rejects ill-conditioned views
+                if (f < 0)
+                {
+                    cerr << "Model " << model.name << " failed: " << ex.what() << endl;
+                    results[m].ok = false;
+                }
+            }
+        }
+    }, (double)tasks);
+
+    // a model that cannot be solved without some of the views gets no held-out error
+    for (size_t m = 0; m < results.size(); m++)
+    {
+        double err = 0;
+        size_t n = 0;
+        bool complete = folds > 0;
+        for (int f = 0; f < folds; f++)
+        {
+            complete = complete && foldErr[m][f] >= 0;
+            err += std::max(foldErr[m][f], 0.);
+            n += foldPoints[m][f];
+        }
+        results[m].heldOutErr = complete && n > 0 ? std::sqrt(err / n) : -1;
+    }
+    return results;
+}
+
+// Write the per-model summary next to the calibration output
+static void saveModelComparison(const Settings& s, const vector<CalibrationResult>& results, int best, int folds)
+{
+    if (!cv::utils::fs::exists(s.xmlOutputDirectory))
+    {
+        cv::utils::fs::createDirectory(s.xmlOutputDirectory);
+    }
+    FileStorage fs(s.xmlOutputDirectory + "/model_comparison.xml", FileStorage::WRITE);
+    fs << "best_model" << (best >= 0 ? results[best].model.name : string());
+    fs << "selection" << (folds > 0 ? "held_out_reprojection_error" : "avg_reprojection_error");
+    fs << "cross_validation_folds" << folds;
+    fs << "models" << "[";
+    for (const CalibrationResult& r : results)
+    {
+        fs << "{" << "name" << r.model.name
+                  << "fisheye_model" << r.model.useFisheye
+                  << "flags" << r.model.flag
+                  << "ok" << r.ok;
+        if (r.ok)
+        {
+            fs << "avg_reprojection_error" << r.totalAvgErr;
+            if (r.heldOutErr >= 0)
+                fs << "held_out_reprojection_error" << r.heldOutErr;
+            fs << "per_view_reprojection_errors" << Mat(r.reprojErrs)
+               << "camera_matrix" << r.cameraMatrix
+               << "distortion_coefficients" << r.distCoeffs;
+        }
+        fs << "}";
+    }
+    fs << "]";
+}
+
+// Solve the model again on K resamples (with replacement) of the captured views, one independent
+// solve per sample, and return a row per intrinsic parameter: 95% interval bounds and std deviation.
+static Mat bootstrapIntervals(Settings& s, const CalibrationModel& model, Size imageSize,
+                              const vector<vector<Point2f> >& imagePoints,
+                              const vector<vector<Point3f> >& objectPoints, float grid_width, bool release_object)
+{
+    const int K = s.bootstrapSamples;
+    const int nViews = (int)imagePoints.size();
+    vector<Mat> samples(K);
+
+    parallel_for_(Range(0, K), [&](const Range& range)
+    {
+        for (int k = range.start; k < range.end; k++)
+        {
+            RNG rng(0x5eed + k);
+            vector<vector<Point2f> > resampled(nViews);
+            vector<vector<Point3f> > resampledObject(objectPoints.empty() ? 0 : nViews);
+            for (int i = 0; i < nViews; i++)
+            {
+                int v = rng.uniform(0, nViews);
+                resampled[i] = imagePoints[v];
+                if (!objectPoints.empty())
+                    resampledObject[i] = objectPoints[v];
+            }
+
+            Size size = imageSize;
+            Mat cameraMatrix, distCoeffs, stdDeviations;
+            vector<Mat> rvecs, tvecs;
+            vector<float> reprojErrs;
+            vector<Point3f> newObjPoints;
+            double totalAvgErr = 0;
+            try
+            {
+                if (!runCalibration(s, model, size, cameraMatrix, distCoeffs, resampled, resampledObject, rvecs,
+                                    tvecs, reprojErrs, totalAvgErr, newObjPoints, stdDeviations, grid_width,
+                                    release_object, false))
+                    continue;
+            }
+            catch (const cv::Exception&)
+            {
+                continue;   // a degenerate resample (e.g. the same view drawn every time)
+            }
+
+            Mat params(4 + (int)distCoeffs.total(), 1, CV_64F);
+            params.at<double>(0) = cameraMatrix.at<double>(0, 0);
+            params.at<double>(1) = cameraMatrix.at<double>(1, 1);
+            params.at<double>(2) = cameraMatrix.at<double>(0, 2);
+            params.at<double>(3) = cameraMatrix.at<double>(1, 2);
+            distCoeffs.reshape(1, (int)distCoeffs.total()).copyTo(params.rowRange(4, params.rows));
+            samples[k] = params;
+        }
+    }, (double)K);
+
+    Mat all;
+    for (const Mat& p : samples)
+        if (!p.empty())
+            all.push_back(Mat(p.t()));
+    cout << "Bootstrap: " << all.rows << "/" << K << " resamples solved" << endl;
+    if (all.rows < 2)
+        return Mat();
+
+    Mat intervals(all.cols, 3, CV_64F);
+    for (int j = 0; j < all.cols; j++)
+    {
+        vector<double> values;
+        all.col(j).copyTo(values);
+        std::sort(values.begin(), values.end());
+
+        size_t lo = (size_t)std::floor(0.025 * (values.size() - 1));
+        size_t hi = (size_t)std::ceil(0.975 * (values.size() - 1));
+        Scalar mu, sigma;
+        meanStdDev(values, mu, sigma);
+
+        intervals.at<double>(j, 0) = values[lo];
+        intervals.at<double>(j, 1) = values[hi];
+        intervals.at<double>(j, 2) = sigma[0];
+    }
+    return intervals;
+}
+
 //! [run_and_save]
 bool runCalibrationAndSave(Settings& s, Size imageSize, Mat& cameraMatrix, Mat& distCoeffs,
-                           vector<vector<Point2f> > imagePoints, float grid_width, bool release_object)
+                           vector<vector<Point2f> > imagePoints, const vector<vector<Point3f> >& objectPoints,
+                           float grid_width, bool release_object)
 {
     vector<Mat> rvecs, tvecs;
     vector<float> reprojErrs;
     double totalAvgErr = 0;
     vector<Point3f> newObjPoints;
+    Mat stdDeviations, intervals;
+    CalibrationModel model = settingsModel(s);
+    bool ok;
+
+    if (s.compareModels)
+    {
+        int folds;
+        vector<CalibrationResult> results = runModelComparison(s, imageSize, imagePoints, objectPoints, grid_width,
+                                                               release_object, folds);
+        if (folds == 0)
+            cout << "Too few views to cross-validate, models are ranked on their training error" << endl;
+
+        // ranked on the held-out error; models without one can only win when none has it
+        auto score = [folds](const CalibrationResult& r) { return folds > 0 ? r.heldOutErr : r.totalAvgErr; };
+        int best = -1;
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const CalibrationResult& r = results[i];
+            cout << "Model " << r.model.name << ": ";
+            if (r.ok)
+            {
+                cout << "avg re projection error = " << r.totalAvgErr;
+                if (r.heldOutErr >= 0)
+                    cout << ", held out = " << r.heldOutErr;
+                cout << endl;
+            }
+            else
+                cout << "failed" << endl;
+            if (r.ok && score(r) >= 0 && (best < 0 || score(r) < score(results[best])))
+                best = (int)i;
+        }
+        saveModelComparison(s, results, best, folds);
+
+        ok = best >= 0;
+        if (ok)
+        {
+            CalibrationResult& r = results[best];
+            cout << "Best model: " << r.model.name << endl;
+            for (size_t i = 0; i < r.reprojErrs.size(); i++)
+                cout << "error" << i << ":" << r.reprojErrs[i] << endl;
+
+            // the rest of the session (undistortion) follows the chosen model
+            model = r.model;
+            s.useFisheye = model.useFisheye;
+            s.flag = model.flag;
+            cameraMatrix = r.cameraMatrix;
+            distCoeffs = r.distCoeffs;
+            rvecs.swap(r.rvecs);
+            tvecs.swap(r.tvecs);
+            reprojErrs.swap(r.reprojErrs);
+            totalAvgErr = r.totalAvgErr;
+            newObjPoints.swap(r.newObjPoints);
+            stdDeviations = r.stdDeviations;
+        }
+    }
+    else
+        ok = runCalibration(s, model, imageSize, cameraMatrix, distCoeffs, imagePoints, objectPoints, rvecs, tvecs,
+                            reprojErrs, totalAvgErr, newObjPoints, stdDeviations, grid_width, release_object);
 
-    bool ok = runCalibration(s, imageSize, cameraMatrix, distCoeffs, imagePoints, rvecs, tvecs, reprojErrs,
-                             totalAvgErr, newObjPoints, grid_width, release_object);
     cout << (ok ? "Calibration succeeded" : "Calibration failed")
          << ". avg re projection error = " << totalAvgErr << endl;
 
+    if (ok && s.bootstrapSamples > 0)
+        intervals = bootstrapIntervals(s, model, imageSize, imagePoints, objectPoints, grid_width, release_object);
+
     if (ok)
-        saveCameraParams(s, imageSize, cameraMatrix, distCoeffs, rvecs, tvecs, reprojErrs, imagePoints,
-                         totalAvgErr, newObjPoints);
+        saveCameraParams(s, model, imageSize, cameraMatrix, distCoeffs, rvecs, tvecs, reprojErrs, imagePoints,
+                         totalAvgErr, newObjPoints, stdDeviations, intervals);
     return ok;
 }
 //! [run_and_save]
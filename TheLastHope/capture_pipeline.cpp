@@ -0,0 +1,81 @@
+#include "capture_pipeline.hpp"
+
+using namespace cv;
+using namespace std;
+
+CapturePipeline::CapturePipeline(FrameSource source, FrameDetector detector, int detectThreads, size_t depth)
+	: source(source), detector(detector), captured(std::max(depth, (size_t)1)),
+	  detected(std::max(depth, (size_t)1) * std::max(detectThreads, 1)), nextSeq(0), finished(false),
+	  runningDetectors(std::max(detectThreads, 1))
+{
+	const int n = runningDetectors;
+	threads.push_back(thread(&CapturePipeline::capture, this));
+	for (int i = 0; i < n; i++)
+		threads.push_back(thread(&CapturePipeline::detect, this));
+}
+
+CapturePipeline::~CapturePipeline()
+{
+	captured.close();
+	detected.close();
+	for (thread& t : threads)
+		t.join();
+}
+
+void CapturePipeline::capture()
+{
+	for (uint64_t seq = 0; ; seq++)
+	{
+		DetectedFrame frame;
+		frame.seq = seq;
+		frame.found = false;
+		source(frame);
+		const bool last = frame.view.empty();
+		if (!captured.push(std::move(frame)) || last)
+			break;
+	}
+	captured.close();
+}
+
+void CapturePipeline::detect()
+{
+	DetectedFrame frame;
+	while (captured.pop(frame))
+	{
+		if (!frame.view.empty())
+			detector(frame);
+		if (!detected.push(std::move(frame)))
+			break;
+	}
+	// the last detector out ends the stream
+	if (--runningDetectors == 0)
+		detected.close();
+}
+
+DetectedFrame CapturePipeline::next()
+{
+	DetectedFrame frame;
+	while (!finished && reorder.find(nextSeq) == reorder.end())
+	{
+		if (!detected.pop(frame))
+		{
+			finished = true;
+			break;
+		}
+		uint64_t seq = frame.seq;
+		reorder[seq] = std::move(frame);
+	}
+
+	map<uint64_t, DetectedFrame>::iterator it = reorder.find(nextSeq);
+	if (it == reorder.end())
+	{
+		frame = DetectedFrame();
+		frame.seq = nextSeq;
+		frame.found = false;
+		return frame;
+	}
+	frame = std::move(it->second);
+	reorder.erase(it);
+	nextSeq++;
+	return frame;
+}
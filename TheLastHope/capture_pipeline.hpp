@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+
+#include "bounded_queue.hpp"
+#include "board_detector.hpp"
+#include "quality_gate.hpp"
+#include "undistortion.hpp"
+
+using namespace cv;
+using namespace std;
+
+// One frame after the capture and detection stages
+struct DetectedFrame
+{
+	uint64_t seq;
+	Mat view;                   // empty once the input is exhausted
+	string imagePath;           // source image of an image list
+	FrameQuality quality;       // a rejected frame is not searched for the board
+	bool found;
+	vector<Point2f> corners;    // full board
+	vector<BoardView> boards;   // partial boards
+	Mat undistorted;            // view remapped for display, when the calibration is shown undistorted
+	Ptr<const ViewUndistorter> undistorter;   // ... with these maps
+};
+
+// Fills view, imagePath and quality; an empty view ends the input
+typedef function<void(DetectedFrame&)> FrameSource;
+// Fills found, corners and boards from view, and undistorted when there are maps to use
+typedef function<void(DetectedFrame&)> FrameDetector;
+
+// Runs the capture loop as a pipeline: one thread grabs frames, `detectThreads` threads
+// search them for the board, and next() hands the results to the caller (which renders and
+// handles the GUI) in capture order. Bounded queues between the stages keep at most `depth`
+// frames in flight per stage, so the frame rate is set by the slowest stage instead of the
+// sum of all of them.
+class CapturePipeline
+{
+public:
+	CapturePipeline(FrameSource source, FrameDetector detector, int detectThreads = 2, size_t depth = 2);
+	~CapturePipeline();
+
+	// Next frame in capture order; blocks until it is detected
+	DetectedFrame next();
+
+private:
+	void capture();
+	void detect();
+
+	FrameSource source;
+	FrameDetector detector;
+	BoundedQueue<DetectedFrame> captured;
+	BoundedQueue<DetectedFrame> detected;
+	map<uint64_t, DetectedFrame> reorder;
+	uint64_t nextSeq;
+	bool finished;
+	atomic<int> runningDetectors;
+	vector<thread> threads;
+};
@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+#include "chessboard_detector.hpp"
+
+using namespace cv;
+using namespace std;
+
+static void to_gray(const Mat& image, Mat& gray)
+{
+	if (image.channels() == 1)
+		gray = image;
+	else
+		cvtColor(image, gray, COLOR_BGR2GRAY);
+}
+
+class ClassicChessboardDetector : public ChessboardDetector
+{
+public:
+	ClassicChessboardDetector(Size boardSize, int flags, int refineWindow)
+		: boardSize(boardSize), flags(flags), refineWindow(refineWindow) {}
+
+	bool detect(const Mat& image, vector<Point2f>& corners) const
+	{
+		if (!findChessboardCorners(image, boardSize, corners, flags))
+			return false;
+		Mat gray;
+		to_gray(image, gray);
+		cornerSubPix(gray, corners, Size(refineWindow, refineWindow), Size(-1, -1),
+			TermCriteria(TermCriteria::EPS + TermCriteria::COUNT, 30, 0.0001));
+		return true;
+	}
+
+private:
+	Size boardSize;
+	int flags;
+	int refineWindow;
+};
+
+// no CALIB_CB_EXHAUSTIVE: it is the slowest mode and these searches run in the live loop
+static const int SB_FLAGS = CALIB_CB_NORMALIZE_IMAGE | CALIB_CB_ACCURACY;
+
+class SBChessboardDetector : public ChessboardDetector
+{
+public:
+	explicit SBChessboardDetector(Size boardSize) : boardSize(boardSize) {}
+
+	bool detect(const Mat& image, vector<Point2f>& corners) const
+	{
+		return findChessboardCornersSB(image, boardSize, corners, SB_FLAGS);
+	}
+
+private:
+	Size boardSize;
+};
+
+class SaddleChessboardDetector : public ChessboardDetector
+{
+public:
+	SaddleChessboardDetector(Size boardSize, double budgetMs)
+		: boardSize(boardSize), workPixels(std::max(budgetMs, 0.1) * PIXELS_PER_MS) {}
+
+	bool detect(const Mat& image, vector<Point2f>& corners) const
+	{
+		// fixed amount of work, so the prefilter costs the same on every frame
+		Mat gray, small;
+		to_gray(image, gray);
+		const double scale = std::min(1.0, std::sqrt(workPixels / gray.total()));
+		if (scale < 1)
+			resize(gray, small, Size(), scale, scale, INTER_AREA);
+		else
+			small = gray;
+
+		Mat response(small.size(), CV_32F);
+		saddleResponse(small, response);
+
+		double maxResponse;
+		minMaxLoc(response, NULL, &maxResponse);
+		if (maxResponse <= 0)
+			return false;
+
+		// saddle points: local maxima above a fraction of the strongest one, at most a fixed
+		// number of them (the strongest) so the tests below cost the same on every frame
+		Mat dilated, peaks;
+		dilate(response, dilated, Mat());
+		peaks = (response >= dilated) & (response > maxResponse * PEAK_RATIO);
+		vector<Point> points;
+		findNonZero(peaks, points);
+		const size_t maxPeaks = (size_t)boardSize.area() * MAX_PEAKS_PER_CORNER;
+		if (points.size() > maxPeaks)
+		{
+			nth_element(points.begin(), points.begin() + maxPeaks, points.end(), [&](const Point& a, const Point& b)
+			{
+				return response.at<float>(a) > response.at<float>(b);
+			});
+			points.resize(maxPeaks);
+		}
+
+		// X-corners only: any texture has saddle points, a chessboard corner is also seen as
+		// two bright and two dark opposite sectors on a ring around it
+		Mat smooth;
+		GaussianBlur(small, smooth, Size(3, 3), 0);
+		vector<Point> xcorners;
+		for (const Point& p : points)
+			if (isXCorner(smooth, p))
+				xcorners.push_back(p);
+
+		// the board: the largest group of X-corners spaced like neighbours on a grid
+		vector<Point> board = largestGrid(xcorners);
+		if ((int)board.size() < boardSize.area() / 2)
+			return false;
+
+		// search only where that group is, with a margin of a few squares
+		Rect box = boundingRect(board);
+		const int margin = (int)(std::max(box.width, box.height) / (double)std::max(boardSize.width, boardSize.height)) + 4;
+		Rect roi(cvFloor((box.x - margin) / scale), cvFloor((box.y - margin) / scale),
+			cvCeil((box.width + 2 * margin) / scale), cvCeil((box.height + 2 * margin) / scale));
+		roi &= Rect(Point(0, 0), gray.size());
+		if (roi.empty())
+			return false;
+
+		if (!findChessboardCornersSB(gray(roi), boardSize, corners, SB_FLAGS))
+			return false;
+		for (Point2f& p : corners)
+			p += Point2f((float)roi.x, (float)roi.y);
+		return true;
+	}
+
+private:
+	// pixels of the prefilter per millisecond of budget (320x240 in the default 5 ms)
+	static constexpr double PIXELS_PER_MS = 320 * 240 / 5.;
+	static constexpr double PEAK_RATIO = 0.1;
+	enum { MAX_PEAKS_PER_CORNER = 8, RING_RADIUS = 3, RING_SAMPLES = 16, MIN_CONTRAST = 16 };
+
+	// Two bright and two dark sectors, each facing one of the same brightness, on a ring of
+	// RING_RADIUS pixels around p
+	static bool isXCorner(const Mat& gray, Point p)
+	{
+		if (p.x < RING_RADIUS || p.y < RING_RADIUS || p.x >= gray.cols - RING_RADIUS || p.y >= gray.rows - RING_RADIUS)
+			return false;
+		int ring[RING_SAMPLES];
+		int lo = 255, hi = 0;
+		for (int k = 0; k < RING_SAMPLES; k++)
+		{
+			const double a = 2 * CV_PI * k / RING_SAMPLES;
+			ring[k] = gray.at<uchar>(p.y + cvRound(RING_RADIUS * sin(a)), p.x + cvRound(RING_RADIUS * cos(a)));
+			lo = std::min(lo, ring[k]);
+			hi = std::max(hi, ring[k]);
+		}
+		if (hi - lo < MIN_CONTRAST)
+			return false;
+
+		const int mid = (lo + hi) / 2;
+		int changes = 0, symmetric = 0;
+		for (int k = 0; k < RING_SAMPLES; k++)
+		{
+			const bool bright = ring[k] > mid;
+			changes += bright != (ring[(k + 1) % RING_SAMPLES] > mid);
+			symmetric += bright == (ring[(k + RING_SAMPLES / 2) % RING_SAMPLES] > mid);
+		}
+		return changes == 4 && symmetric >= RING_SAMPLES * 3 / 4;
+	}
+
+	// Largest set of points linked through neighbours: two points are linked when each is
+	// about the nearest-neighbour distance of the other away, so the corners of a board
+	// (evenly spaced, up to perspective) group together and scattered texture does not
+	static vector<Point> largestGrid(const vector<Point>& points)
+	{
+		const int n = (int)points.size();
+		vector<double> nearest(n, DBL_MAX);
+		for (int i = 0; i < n; i++)
+			for (int j = 0; j < n; j++)
+				if (i != j)
+					nearest[i] = std::min(nearest[i], norm(points[i] - points[j]));
+
+		vector<int> parent(n);
+		iota(parent.begin(), parent.end(), 0);
+		auto root = [&](int i)
+		{
+			while (parent[i] != i)
+				i = parent[i] = parent[parent[i]];
+			return i;
+		};
+		for (int i = 0; i < n; i++)
+			for (int j = i + 1; j < n; j++)
+			{
+				const double d = norm(points[i] - points[j]);
+				if (d <= 1.5 * nearest[i] && d <= 1.5 * nearest[j] &&
+					nearest[i] <= 2 * nearest[j] && nearest[j] <= 2 * nearest[i])
+					parent[root(i)] = root(j);
+			}
+
+		vector<int> size(n, 0);
+		int best = -1;
+		for (int i = 0; i < n; i++)
+		{
+			const int r = root(i);
+			if (++size[r] > (best < 0 ? 0 : size[best]))
+				best = r;
+		}
+		vector<Point> grid;
+		for (int i = 0; i < n; i++)
+			if (root(i) == best)
+				grid.push_back(points[i]);
+		return grid;
+	}
+
+	// -det(Hessian) of the smoothed image, positive at saddle points, computed in row bands
+	// (each with a 3 pixel border so the bands join seamlessly)
+	static void saddleResponse(const Mat& gray, Mat& response)
+	{
+		const int bands = std::max(1, std::min(getNumThreads(), gray.rows / 16));
+		parallel_for_(Range(0, bands), [&](const Range& range)
+		{
+			for (int b = range.start; b < range.end; b++)
+			{
+				const int y0 = gray.rows * b / bands, y1 = gray.rows * (b + 1) / bands;
+				const int top = std::max(y0 - 3, 0), bottom = std::min(y1 + 3, gray.rows);
+
+				Mat band, xx, yy, xy;
+				GaussianBlur(gray.rowRange(top, bottom), band, Size(3, 3), 0);
+				band.convertTo(band, CV_32F);
+				Sobel(band, xx, CV_32F, 2, 0, 3);
+				Sobel(band, yy, CV_32F, 0, 2, 3);
+				Sobel(band, xy, CV_32F, 1, 1, 3);
+
+				Mat det = xy.mul(xy) - xx.mul(yy);
+				det.rowRange(y0 - top, y1 - top).copyTo(response.rowRange(y0, y1));
+			}
+		});
+	}
+
+	Size boardSize;
+	double workPixels;
+};
+
+constexpr double SaddleChessboardDetector::PIXELS_PER_MS;
+constexpr double SaddleChessboardDetector::PEAK_RATIO;
+
+Ptr<ChessboardDetector> ChessboardDetector::create(Backend backend, Size boardSize, int classicFlags,
+	int refineWindow, double budgetMs)
+{
+	switch (backend)
+	{
+	case SB:
+		return makePtr<SBChessboardDetector>(boardSize);
+	case SADDLE:
+		return makePtr<SaddleChessboardDetector>(boardSize, budgetMs);
+	default:
+		return makePtr<ClassicChessboardDetector>(boardSize, classicFlags, refineWindow);
+	}
+}
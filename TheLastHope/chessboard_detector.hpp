@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Chessboard corner search with interchangeable backends. detect() returns refined corners
+// and may be called from several threads at once.
+//  CLASSIC  findChessboardCorners followed by cornerSubPix
+//  SB       findChessboardCornersSB (sub-pixel accurate on its own)
+//  SADDLE   a saddle-point response on a reduced copy of the frame, computed in parallel
+//           bands, rejects frames without a grid of X-corners in a few milliseconds; frames
+//           that pass run findChessboardCornersSB on the region holding that grid only
+class ChessboardDetector
+{
+public:
+	enum Backend { CLASSIC, SB, SADDLE };
+
+	virtual ~ChessboardDetector() {}
+
+	// classicFlags are the findChessboardCorners flags, refineWindow the cornerSubPix half-window;
+	// budgetMs sizes the SADDLE prefilter: it runs on as many pixels as a typical core handles
+	// in that time, so the outcome only depends on the frame, never on the machine load
+	static Ptr<ChessboardDetector> create(Backend backend, Size boardSize, int classicFlags,
+		int refineWindow = 11, double budgetMs = 5);
+
+	virtual bool detect(const Mat& image, vector<Point2f>& corners) const = 0;
+};
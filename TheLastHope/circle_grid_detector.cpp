@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+#include "circle_grid_detector.hpp"
+
+using namespace cv;
+using namespace std;
+
+ParallelBlobDetector::ParallelBlobDetector(const SimpleBlobDetector::Params& params, int adaptiveRange)
+	: params(params), adaptiveRange(adaptiveRange)
+{
+	if (this->params.thresholdStep <= 0)
+		this->params.thresholdStep = 10;
+	if (this->params.minRepeatability < 1)
+		this->params.minRepeatability = 1;
+}
+
+void ParallelBlobDetector::detect(InputArray image, vector<KeyPoint>& keypoints, InputArray mask)
+{
+	keypoints.clear();
+	Mat gray = image.getMat();
+	if (gray.empty())
+		return;
+	if (gray.channels() != 1)
+		cvtColor(gray, gray, COLOR_BGR2GRAY);
+
+	double lo = params.minThreshold, hi = params.maxThreshold;
+	if (adaptiveRange > 0)
+	{
+		Mat scratch;
+		const double otsu = threshold(gray, scratch, 0, 255, THRESH_BINARY | THRESH_OTSU);
+		lo = std::max(lo, otsu - adaptiveRange / 2.);
+		hi = std::min(hi, otsu + adaptiveRange / 2.);
+		// never sweep fewer levels than a blob has to be seen on
+		hi = std::max(hi, lo + params.thresholdStep * params.minRepeatability);
+	}
+	const int levels = std::max(1, cvCeil((hi - lo) / params.thresholdStep));
+
+	vector<vector<KeyPoint> > found(levels);
+	parallel_for_(Range(0, levels), [&](const Range& range)
+	{
+		for (int i = range.start; i < range.end; i++)
+		{
+			SimpleBlobDetector::Params level = params;
+			level.minThreshold = (float)(lo + i * params.thresholdStep);
+			level.maxThreshold = level.minThreshold + params.thresholdStep;
+			level.minRepeatability = 1;
+			SimpleBlobDetector::create(level)->detect(gray, found[i]);
+		}
+	});
+
+	// merge the levels in threshold order, like SimpleBlobDetector
+	vector<vector<KeyPoint> > groups;
+	for (const vector<KeyPoint>& level : found)
+	{
+		const size_t known = groups.size();
+		for (const KeyPoint& kp : level)
+		{
+			bool merged = false;
+			for (size_t g = 0; g < known && !merged; g++)
+			{
+				const KeyPoint& last = groups[g].back();
+				const double dist = norm(last.pt - kp.pt);
+				if (dist < params.minDistBetweenBlobs || dist < last.size / 2)
+				{
+					groups[g].push_back(kp);
+					merged = true;
+				}
+			}
+			if (!merged)
+				groups.push_back(vector<KeyPoint>(1, kp));
+		}
+	}
+
+	for (const vector<KeyPoint>& g : groups)
+	{
+		if (g.size() < params.minRepeatability)
+			continue;
+		Point2f center(0, 0);
+		for (const KeyPoint& kp : g)
+			center += kp.pt;
+		center *= 1.f / g.size();
+		keypoints.push_back(KeyPoint(center, g[g.size() / 2].size));
+	}
+
+	if (!mask.empty())
+		KeyPointsFilter::runByPixelsMask(keypoints, mask.getMat());
+}
+
+CircleGridDetector::CircleGridDetector(Size boardSize, bool asymmetric, const SimpleBlobDetector::Params& params,
+	int adaptiveRange, bool reuseRoi)
+	: boardSize(boardSize), flags(asymmetric ? CALIB_CB_ASYMMETRIC_GRID : CALIB_CB_SYMMETRIC_GRID),
+	  blobs(makePtr<ParallelBlobDetector>(params, adaptiveRange)), reuseRoi(reuseRoi)
+{
+}
+
+bool CircleGridDetector::detectIn(const Mat& image, vector<Point2f>& centers) const
+{
+	return findCirclesGrid(image, boardSize, centers, flags, blobs);
+}
+
+bool CircleGridDetector::detect(const Mat& image, vector<Point2f>& centers)
+{
+	Rect roi;
+	if (reuseRoi)
+	{
+		lock_guard<mutex> guard(roiLock);
+		roi = lastRoi;
+	}
+
+	bool found = false;
+	if (!roi.empty() && roi.area() < image.size().area())
+	{
+		found = detectIn(image(roi), centers);
+		if (found)
+			for (Point2f& p : centers)
+				p += Point2f((float)roi.x, (float)roi.y);
+	}
+	if (!found)
+	{
+		centers.clear();
+		found = detectIn(image, centers);
+	}
+
+	if (reuseRoi)
+	{
+		// the last grid plus a quarter of its size on every side
+		Rect box;
+		if (found)
+		{
+			box = boundingRect(centers);
+			box = Rect(box.x - box.width / 4, box.y - box.height / 4, box.width * 3 / 2, box.height * 3 / 2)
+				& Rect(Point(0, 0), image.size());
+		}
+		lock_guard<mutex> guard(roiLock);
+		lastRoi = box;
+	}
+	return found;
+}
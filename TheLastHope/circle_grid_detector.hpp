@@ -0,0 +1,49 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Drop-in replacement of SimpleBlobDetector for findCirclesGrid. Every threshold level is an
+// independent single-level SimpleBlobDetector run on its own thread; the blobs of all levels are
+// then merged as SimpleBlobDetector does (same blob = closer than minDistBetweenBlobs or its
+// radius, kept when seen on minRepeatability levels).
+// With adaptiveRange > 0 only the thresholds within adaptiveRange / 2 of the Otsu threshold of the
+// frame are swept, which on backlit targets is where the circles separate from the background.
+class ParallelBlobDetector : public Feature2D
+{
+public:
+	ParallelBlobDetector(const SimpleBlobDetector::Params& params, int adaptiveRange = 0);
+
+	void detect(InputArray image, vector<KeyPoint>& keypoints, InputArray mask = noArray());
+
+private:
+	SimpleBlobDetector::Params params;
+	int adaptiveRange;
+};
+
+// findCirclesGrid on top of ParallelBlobDetector. With reuseRoi the grid is first searched around
+// where it was found last time, and in the whole frame only when that fails.
+class CircleGridDetector
+{
+public:
+	CircleGridDetector(Size boardSize, bool asymmetric, const SimpleBlobDetector::Params& params,
+		int adaptiveRange = 0, bool reuseRoi = false);
+
+	bool detect(const Mat& image, vector<Point2f>& centers);
+
+private:
+	bool detectIn(const Mat& image, vector<Point2f>& centers) const;
+
+	Size boardSize;
+	int flags;
+	Ptr<FeatureDetector> blobs;
+	bool reuseRoi;
+	mutex roiLock;
+	Rect lastRoi;
+};
@@ -0,0 +1,93 @@
+#include <cmath>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+#include "coverage.hpp"
+
+using namespace cv;
+using namespace std;
+
+CoverageMap::CoverageMap(Size imageSize, Size grid, int angleBins, double maxAngleDeg)
+	: size(imageSize), grid(grid), angleBins(std::max(angleBins, 1)), maxAngle(maxAngleDeg * CV_PI / 180)
+{
+	clear();
+}
+
+void CoverageMap::clear()
+{
+	cellHits = Mat::zeros(grid, CV_32S);
+	angleHits = Mat::zeros(angleBins, angleBins, CV_32S);
+	nViews = 0;
+	dirty = true;
+}
+
+void CoverageMap::addView(const vector<Point2f>& corners, const vector<Point2f>& planarPoints)
+{
+	if (size.area() == 0 || corners.empty())
+		return;
+
+	for (const Point2f& p : corners)
+	{
+		int cx = std::min(std::max((int)(p.x * grid.width / size.width), 0), grid.width - 1);
+		int cy = std::min(std::max((int)(p.y * grid.height / size.height), 0), grid.height - 1);
+		cellHits.at<int>(cy, cx)++;
+	}
+
+	// Tilt of the board plane: with H ~ K [r1 r2 t], the normal is r1 x r2. A nominal camera
+	// (focal length = image width, centred principal point) is enough to tell the tilts apart.
+	if (corners.size() == planarPoints.size() && corners.size() >= 4)
+	{
+		Mat H = findHomography(planarPoints, corners);
+		if (!H.empty())
+		{
+			const double f = size.width, cx = size.width * 0.5, cy = size.height * 0.5;
+			Matx33d Kinv(1 / f, 0, -cx / f, 0, 1 / f, -cy / f, 0, 0, 1);
+			Matx33d h(H);
+			Vec3d r1 = Kinv * Vec3d(h(0, 0), h(1, 0), h(2, 0));
+			Vec3d r2 = Kinv * Vec3d(h(0, 1), h(1, 1), h(2, 1));
+			Vec3d n = r1.cross(r2);
+			if (n[2] < 0)
+				n = -n;
+			double ax = std::atan2(n[1], n[2]), ay = std::atan2(n[0], n[2]);
+			int bx = (int)((ax + maxAngle) / (2 * maxAngle) * angleBins);
+			int by = (int)((ay + maxAngle) / (2 * maxAngle) * angleBins);
+			bx = std::min(std::max(bx, 0), angleBins - 1);
+			by = std::min(std::max(by, 0), angleBins - 1);
+			angleHits.at<int>(by, bx)++;
+		}
+	}
+
+	nViews++;
+	dirty = true;
+}
+
+double CoverageMap::cellCoverage() const
+{
+	return (double)countNonZero(cellHits) / grid.area();
+}
+
+int CoverageMap::poseBins() const
+{
+	return countNonZero(angleHits);
+}
+
+bool CoverageMap::enough(double cellTarget, int minPoseBins, int minViews) const
+{
+	return nViews >= minViews && cellCoverage() >= cellTarget && poseBins() >= minPoseBins;
+}
+
+void CoverageMap::draw(Mat& view, double alpha)
+{
+	if (view.empty() || view.type() != CV_8UC3)
+		return;
+
+	if (dirty || overlay.size() != view.size())
+	{
+		Mat cells(grid, CV_8UC3);
+		for (int y = 0; y < grid.height; y++)
+			for (int x = 0; x < grid.width; x++)
+				cells.at<Vec3b>(y, x) = cellHits.at<int>(y, x) > 0 ? Vec3b(0, 255, 0) : Vec3b(0, 0, 255);
+		resize(cells, overlay, view.size(), 0, 0, INTER_NEAREST);
+		dirty = false;
+	}
+	addWeighted(view, 1 - alpha, overlay, alpha, 0, view);
+}
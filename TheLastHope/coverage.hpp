@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Tracks which parts of the image and which board tilts the accepted views already cover.
+// Each view costs O(corners): its corners are binned into a coarse grid over the image and
+// its tilt (estimated from the board homography with a nominal camera) into a small grid of
+// angle bins. The overlay is rebuilt only when a view was added.
+class CoverageMap
+{
+public:
+	CoverageMap(Size imageSize = Size(), Size grid = Size(16, 12), int angleBins = 5, double maxAngleDeg = 60);
+
+	Size imageSize() const { return size; }
+
+	// planarPoints are the board coordinates (z = 0) of the corners
+	void addView(const vector<Point2f>& corners, const vector<Point2f>& planarPoints);
+	void clear();
+
+	double cellCoverage() const;   // fraction of grid cells holding at least one corner
+	int poseBins() const;          // number of distinct tilt bins seen
+	int views() const { return nViews; }
+
+	// True once the views cover at least cellTarget of the image in at least minPoseBins tilts
+	bool enough(double cellTarget, int minPoseBins, int minViews = 3) const;
+
+	// Blends the coverage over view: cells without corners red, covered cells green
+	void draw(Mat& view, double alpha = 0.3);
+
+private:
+	Size size;
+	Size grid;
+	int angleBins;
+	double maxAngle;
+	Mat cellHits;    // CV_32S, grid.height x grid.width
+	Mat angleHits;   // CV_32S, angleBins x angleBins (tilt about x, tilt about y)
+	int nViews;
+	Mat overlay;     // cached rendering at the size of the last drawn view
+	bool dirty;
+};
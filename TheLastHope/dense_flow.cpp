@@ -0,0 +1,122 @@
+#include <iostream>
+#include <algorithm>
+#include <climits>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+#include "dense_flow.hpp"
+
+using namespace cv;
+using namespace std;
+
+static const char FLOW_MAGIC[4] = { 'F', 'L', 'W', '1' };
+
+template<typename T> static void write_pod(ostream& out, const T& value)
+{
+	out.write((const char*)&value, sizeof(T));
+}
+
+TiledDenseFlow::TiledDenseFlow(Method method, double scale, int bands, int overlap)
+	: method(method), scale(scale > 0 && scale <= 1 ? scale : 1), bands(bands), overlap(std::max(overlap, 0))
+{
+}
+
+Ptr<DenseOpticalFlow> TiledDenseFlow::createEngine() const
+{
+	if (method == FARNEBACK)
+		return FarnebackOpticalFlow::create();
+	return DISOpticalFlow::create(DISOpticalFlow::PRESET_FAST);
+}
+
+void TiledDenseFlow::compute(const Mat& prevGray, const Mat& gray, Mat& flow, Mat& valid, Rect roi, const Mat& mask)
+{
+	CV_Assert(prevGray.size() == gray.size() && gray.type() == CV_8UC1);
+	const Size outSize(cvRound(gray.cols * scale), cvRound(gray.rows * scale));
+	flow.create(outSize, CV_32FC2);
+	flow.setTo(Scalar::all(0));
+	valid.create(outSize, CV_8U);
+	valid.setTo(Scalar::all(0));
+
+	// only the bounding box of roi and mask is resized and computed
+	Rect region(Point(0, 0), gray.size());
+	if (!roi.empty())
+		region &= roi;
+	if (!mask.empty())
+	{
+		vector<Point> inside;
+		findNonZero(mask, inside);
+		region &= inside.empty() ? Rect() : boundingRect(inside);
+	}
+	Rect outRegion(cvFloor(region.x * scale), cvFloor(region.y * scale),
+		cvCeil(region.width * scale), cvCeil(region.height * scale));
+	outRegion &= Rect(Point(0, 0), outSize);
+	if (outRegion.width < 8 || outRegion.height < 8)
+		return;
+	region = Rect(cvFloor(outRegion.x / scale), cvFloor(outRegion.y / scale),
+		cvCeil(outRegion.width / scale), cvCeil(outRegion.height / scale)) & Rect(Point(0, 0), gray.size());
+
+	Mat a, b;
+	resize(prevGray(region), a, outRegion.size(), 0, 0, INTER_AREA);
+	resize(gray(region), b, outRegion.size(), 0, 0, INTER_AREA);
+
+	// bands too thin for the pyramids of the flow engines are merged
+	int n = bands > 0 ? bands : getNumThreads();
+	n = std::max(1, std::min(n, a.rows / 32));
+	while ((int)engines.size() < n)
+		engines.push_back(createEngine());
+
+	Mat regionFlow = flow(outRegion);
+	parallel_for_(Range(0, n), [&](const Range& range)
+	{
+		for (int i = range.start; i < range.end; i++)
+		{
+			const int y0 = a.rows * i / n, y1 = a.rows * (i + 1) / n;
+			const int top = std::max(y0 - overlap, 0), bottom = std::min(y1 + overlap, a.rows);
+			Mat bandFlow;
+			engines[i]->calc(a.rowRange(top, bottom), b.rowRange(top, bottom), bandFlow);
+			bandFlow.rowRange(y0 - top, y1 - top).copyTo(regionFlow.rowRange(y0, y1));
+		}
+	});
+	// back to input pixels
+	regionFlow *= 1. / scale;
+
+	valid(outRegion).setTo(Scalar::all(255));
+	if (!mask.empty())
+	{
+		Mat smallMask;
+		resize(mask, smallMask, outSize, 0, 0, INTER_NEAREST);
+		bitwise_and(valid, smallMask != 0, valid);
+		flow.setTo(Scalar::all(0), valid == 0);
+	}
+}
+
+FlowWriter::FlowWriter(const string& fileName, Size fieldSize, float step)
+	: out(fileName.c_str(), ios::binary | ios::trunc), fieldSize(fieldSize), step(step > 0 ? step : 1.f / 16)
+{
+	if (!out)
+	{
+		cerr << "Could not create the flow stream " << fileName << endl;
+		return;
+	}
+	out.write(FLOW_MAGIC, sizeof(FLOW_MAGIC));
+	write_pod(out, (int32_t)fieldSize.width);
+	write_pod(out, (int32_t)fieldSize.height);
+	write_pod(out, this->step);
+}
+
+void FlowWriter::write(uint32_t frameIndex, const Mat& flow, const Mat& valid)
+{
+	if (!out)
+		return;
+	CV_Assert(flow.size() == fieldSize && flow.type() == CV_32FC2);
+
+	// INT16_MIN is reserved for the pixels without flow
+	Mat q;
+	flow.convertTo(q, CV_16SC2, 1. / step);
+	max(q, Scalar::all(SHRT_MIN + 1), q);
+	if (!valid.empty())
+		q.setTo(Scalar::all(SHRT_MIN), valid == 0);
+
+	write_pod(out, frameIndex);
+	for (int y = 0; y < q.rows; y++)
+		out.write((const char*)q.ptr(y), q.cols * q.elemSize());
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/video.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Dense optical flow at a reduced resolution, split into horizontal bands (overlapping by
+// `overlap` rows so the bands join without seams) that are computed in parallel, each by its
+// own flow engine. Only the part of the frame inside roi and the non-zero pixels of mask is
+// computed.
+class TiledDenseFlow
+{
+public:
+	enum Method { FARNEBACK, DIS };
+
+	// scale: output resolution as a fraction of the input; bands = 0 uses one band per thread
+	TiledDenseFlow(Method method, double scale = 0.5, int bands = 0, int overlap = 16);
+
+	// prevGray and gray are 8-bit frames at input resolution. flow (CV_32FC2) is at the output
+	// resolution but in input pixels; valid (CV_8U) is non-zero where the flow was computed, and
+	// the flow is zero everywhere else.
+	void compute(const Mat& prevGray, const Mat& gray, Mat& flow, Mat& valid,
+		Rect roi = Rect(), const Mat& mask = Mat());
+
+private:
+	Ptr<DenseOpticalFlow> createEngine() const;
+
+	Method method;
+	double scale;
+	int bands;
+	int overlap;
+	vector<Ptr<DenseOpticalFlow> > engines;
+};
+
+// Quantized flow fields: a "FLW1" header with the field width, height and quantization step
+// (pixels per unit), then per frame the frame index and width * height (dx, dy) int16 pairs.
+// Pixels without flow are written as INT16_MIN.
+class FlowWriter
+{
+public:
+	FlowWriter(const string& fileName, Size fieldSize, float step = 1.f / 16);
+
+	bool isOpen() const { return (bool)out; }
+	void write(uint32_t frameIndex, const Mat& flow, const Mat& valid);
+
+private:
+	ofstream out;
+	Size fieldSize;
+	float step;
+};
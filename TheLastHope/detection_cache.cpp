@@ -0,0 +1,163 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "detection_cache.hpp"
+
+using namespace cv;
+using namespace std;
+
+static const char CACHE_MAGIC[4] = { 'D', 'C', 'C', '1' };
+
+static bool file_stamp(const string& path, int64& fileSize, int64& mtime)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return false;
+	fileSize = (int64)st.st_size;
+	mtime = (int64)st.st_mtime;
+	return true;
+}
+
+template<typename T> static void write_pod(ostream& out, const T& value)
+{
+	out.write((const char*)&value, sizeof(T));
+}
+
+template<typename T> static bool read_pod(istream& in, T& value)
+{
+	return (bool)in.read((char*)&value, sizeof(T));
+}
+
+uint64 board_signature(Size boardSize, int pattern, int winSize, int detectorFlags, bool flipped,
+	const vector<float>& detectorParams)
+{
+	// FNV-1a
+	vector<int> fields = { boardSize.width, boardSize.height, pattern, winSize, detectorFlags, flipped };
+	for (float p : detectorParams)
+	{
+		int bits;
+		memcpy(&bits, &p, sizeof(bits));
+		fields.push_back(bits);
+	}
+	uint64 h = 14695981039346656037ULL;
+	for (int f : fields)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			h ^= (uint64)((f >> (8 * i)) & 0xff);
+			h *= 1099511628211ULL;
+		}
+	}
+	return h;
+}
+
+DetectionCache::DetectionCache(const string& fileName, uint64 signature)
+	: fileName(fileName), signature(signature), dirty(false)
+{
+	if (load())
+		cout << "Detection cache: " << entries.size() << " entries loaded from " << fileName << endl;
+}
+
+bool DetectionCache::lookup(const string& imagePath, Size& imageSize, vector<Point2f>& corners, bool& found) const
+{
+	map<string, Entry>::const_iterator it = entries.find(imagePath);
+	if (it == entries.end() || it->second.signature != signature)
+		return false;
+
+	int64 fileSize, mtime;
+	if (!file_stamp(imagePath, fileSize, mtime) || fileSize != it->second.fileSize || mtime != it->second.mtime)
+		return false;
+
+	imageSize = it->second.imageSize;
+	corners = it->second.corners;
+	found = it->second.found;
+	return true;
+}
+
+void DetectionCache::store(const string& imagePath, Size imageSize, const vector<Point2f>& corners, bool found)
+{
+	Entry e;
+	if (!isOpen() || !file_stamp(imagePath, e.fileSize, e.mtime))
+		return;
+	e.signature = signature;
+	e.imageSize = imageSize;
+	e.found = found;
+	if (found)
+		e.corners = corners;
+	entries[imagePath] = e;
+	dirty = true;
+}
+
+// Layout: magic, entry count, then per entry the path, file stamp, board signature, image size,
+// found flag and the refined corners as float pairs.
+bool DetectionCache::save()
+{
+	if (!isOpen() || !dirty)
+		return true;
+
+	ofstream out(fileName.c_str(), ios::binary | ios::trunc);
+	if (!out)
+	{
+		cerr << "Could not write the detection cache " << fileName << endl;
+		return false;
+	}
+	out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	write_pod(out, (uint32_t)entries.size());
+	for (const auto& kv : entries)
+	{
+		const Entry& e = kv.second;
+		write_pod(out, (uint32_t)kv.first.size());
+		out.write(kv.first.data(), kv.first.size());
+		write_pod(out, e.fileSize);
+		write_pod(out, e.mtime);
+		write_pod(out, e.signature);
+		write_pod(out, (int32_t)e.imageSize.width);
+		write_pod(out, (int32_t)e.imageSize.height);
+		write_pod(out, (uint8_t)e.found);
+		write_pod(out, (uint32_t)e.corners.size());
+		if (!e.corners.empty())
+			out.write((const char*)&e.corners[0], e.corners.size() * sizeof(Point2f));
+	}
+	dirty = false;
+	return (bool)out;
+}
+
+bool DetectionCache::load()
+{
+	ifstream in(fileName.c_str(), ios::binary);
+	if (!in)
+		return false;
+
+	char magic[sizeof(CACHE_MAGIC)];
+	uint32_t count;
+	if (!in.read(magic, sizeof(magic)) || !equal(magic, magic + sizeof(magic), CACHE_MAGIC) || !read_pod(in, count))
+	{
+		cerr << "Ignoring invalid detection cache " << fileName << endl;
+		return false;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Entry e;
+		uint32_t pathLength, nCorners;
+		int32_t width, height;
+		uint8_t found;
+		if (!read_pod(in, pathLength))
+			break;
+		string path(pathLength, '\0');
+		if (!in.read(&path[0], pathLength) ||
+			!read_pod(in, e.fileSize) || !read_pod(in, e.mtime) || !read_pod(in, e.signature) ||
+			!read_pod(in, width) || !read_pod(in, height) || !read_pod(in, found) || !read_pod(in, nCorners))
+			break;
+		e.corners.resize(nCorners);
+		if (nCorners && !in.read((char*)&e.corners[0], nCorners * sizeof(Point2f)))
+			break;
+		e.imageSize = Size(width, height);
+		e.found = found != 0;
+		entries[path] = e;
+	}
+	return true;
+}
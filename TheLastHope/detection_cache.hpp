@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <opencv2/core.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Hash of everything that changes the detected corners of an image: board geometry, pattern,
+// cornerSubPix window, detector flags and parameters, and input flipping. Entries stored under another
+// signature are ignored.
+uint64 board_signature(Size boardSize, int pattern, int winSize, int detectorFlags, bool flipped,
+	const vector<float>& detectorParams = vector<float>());
+
+// On-disk cache of pattern detections, keyed by image path and validated against the file's
+// size and modification time, so that re-running a calibration over the same image list
+// (e.g. after changing only solver flags) does not decode and search every image again.
+class DetectionCache
+{
+public:
+	DetectionCache() : signature(0), dirty(false) {}
+	DetectionCache(const string& fileName, uint64 signature);
+
+	bool isOpen() const { return !fileName.empty(); }
+
+	// Returns true when a still valid entry exists; found tells whether the pattern was detected
+	bool lookup(const string& imagePath, Size& imageSize, vector<Point2f>& corners, bool& found) const;
+	void store(const string& imagePath, Size imageSize, const vector<Point2f>& corners, bool found);
+
+	bool save();
+
+private:
+	struct Entry
+	{
+		int64 fileSize;
+		int64 mtime;
+		uint64 signature;
+		Size imageSize;
+		bool found;
+		vector<Point2f> corners;
+	};
+
+	bool load();
+
+	string fileName;
+	uint64 signature;
+	map<string, Entry> entries;
+	bool dirty;
+};
@@ -0,0 +1,86 @@
+#include <iostream>
+#include "frame_pool.hpp"
+
+using namespace cv;
+using namespace std;
+
+static bool is_free(const Mat& buffer)
+{
+	return buffer.u && buffer.u->refcount == 1;
+}
+
+static size_t bytes(const Mat& buffer)
+{
+	return buffer.total() * buffer.elemSize();
+}
+
+FramePool::FramePool(const string& name, size_t maxBuffers)
+	: name(name), maxBuffers(maxBuffers), highWater(0), allocations(0), overflows(0)
+{
+}
+
+FramePool::~FramePool()
+{
+	if (allocations)
+		report();
+}
+
+Mat FramePool::get(Size size, int type)
+{
+	if (size.area() <= 0)
+		return Mat();
+
+	lock_guard<mutex> guard(lock);
+	int chosen = -1, replaceable = -1;
+	for (size_t i = 0; i < buffers.size() && chosen < 0; i++)
+	{
+		if (!is_free(buffers[i]))
+			continue;
+		if (buffers[i].size() == size && buffers[i].type() == type)
+			chosen = (int)i;
+		else
+			replaceable = (int)i;
+	}
+
+	if (chosen < 0)
+	{
+		if (replaceable < 0 && buffers.size() >= maxBuffers)
+		{
+			overflows++;
+			return Mat(size, type);
+		}
+		if (replaceable < 0)
+		{
+			replaceable = (int)buffers.size();
+			buffers.push_back(Mat());
+		}
+		buffers[replaceable] = Mat(size, type);
+		allocations++;
+		chosen = replaceable;
+	}
+
+	Mat frame = buffers[chosen];
+	size_t inUse = 0;
+	for (const Mat& b : buffers)
+		if (!is_free(b))
+			inUse += bytes(b);
+	highWater = std::max(highWater, inUse);
+	return frame;
+}
+
+size_t FramePool::highWaterBytes() const
+{
+	lock_guard<mutex> guard(lock);
+	return highWater;
+}
+
+void FramePool::report() const
+{
+	lock_guard<mutex> guard(lock);
+	size_t pooled = 0;
+	for (const Mat& b : buffers)
+		pooled += bytes(b);
+	cout << "Frame pool " << name << ": " << buffers.size() << " buffers (" << pooled / (1024 * 1024.) << " MB), "
+	     << "high water " << highWater / (1024 * 1024.) << " MB, " << allocations << " allocations, "
+	     << overflows << " frames outside the pool" << endl;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Recycles frame buffers instead of allocating a new image per frame. get() hands out a Mat
+// sharing one of the pool's buffers; the buffer is free again as soon as every Mat referring
+// to it is gone (the pool is then the only holder of OpenCV's reference count), whichever
+// thread or stage that happens on. Buffers of another format are replaced as the stream
+// format changes. When all maxBuffers buffers are busy get() falls back on a plain allocation.
+class FramePool
+{
+public:
+	explicit FramePool(const string& name, size_t maxBuffers = 16);
+	~FramePool();
+
+	Mat get(Size size, int type);
+
+	// Pooled bytes handed out at once, at most
+	size_t highWaterBytes() const;
+	void report() const;
+
+private:
+	string name;
+	size_t maxBuffers;
+	mutable mutex lock;
+	vector<Mat> buffers;
+	size_t highWater;
+	size_t allocations;
+	size_t overflows;
+};
@@ -0,0 +1,279 @@
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <opencv2/imgcodecs.hpp>
+#include "frame_recorder.hpp"
+
+using namespace cv;
+using namespace std;
+
+static const char RECORDING_MAGIC[4] = { 'F', 'R', 'R', '1' };
+
+enum RecordType { RECORD_FRAME = 1, RECORD_KEY = 2, RECORD_MOUSE = 3 };
+enum FrameEncoding { ENCODING_RAW = 0, ENCODING_PNG = 1 };
+
+template<typename T> static void write_pod(ostream& out, const T& value)
+{
+	out.write((const char*)&value, sizeof(T));
+}
+
+template<typename T> static bool read_pod(istream& in, T& value)
+{
+	return (bool)in.read((char*)&value, sizeof(T));
+}
+
+FrameRecorder::FrameRecorder(const string& fileName, bool compress, int chunkFrames)
+	: out(fileName.c_str(), ios::binary | ios::trunc), chunkRecords(0), chunkFrames(std::max(chunkFrames, 1)),
+	  framesInChunk(0), compress(compress), frameCount(0), start(chrono::steady_clock::now())
+{
+	if (!out)
+	{
+		cerr << "Could not create the recording " << fileName << endl;
+		return;
+	}
+	out.write(RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+	cout << "Recording the session to " << fileName << endl;
+}
+
+FrameRecorder::~FrameRecorder()
+{
+	flush();
+}
+
+// Record layout: type, timestamp in microseconds since the start, then the payload.
+void FrameRecorder::beginRecord(uint8_t type)
+{
+	int64_t t = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+	write_pod(chunk, type);
+	write_pod(chunk, t);
+	chunkRecords++;
+}
+
+// Frame payload: rows, cols, type, encoding, byte count and the bytes.
+void FrameRecorder::frame(const Mat& image)
+{
+	if (!isOpen() || image.empty())
+		return;
+
+	vector<uchar> png;
+	int32_t encoding = ENCODING_RAW;
+	if (compress && imencode(".png", image, png, vector<int>{ IMWRITE_PNG_COMPRESSION, 1 }))
+		encoding = ENCODING_PNG;
+
+	beginRecord(RECORD_FRAME);
+	write_pod(chunk, (int32_t)image.rows);
+	write_pod(chunk, (int32_t)image.cols);
+	write_pod(chunk, (int32_t)image.type());
+	write_pod(chunk, encoding);
+	if (encoding == ENCODING_PNG)
+	{
+		write_pod(chunk, (uint32_t)png.size());
+		chunk.write((const char*)&png[0], png.size());
+	}
+	else
+	{
+		Mat continuous = image.isContinuous() ? image : image.clone();
+		const size_t bytes = continuous.total() * continuous.elemSize();
+		write_pod(chunk, (uint32_t)bytes);
+		chunk.write((const char*)continuous.data, bytes);
+	}
+	frameCount++;
+
+	if (++framesInChunk >= chunkFrames)
+		flush();
+}
+
+void FrameRecorder::key(int key)
+{
+	if (!isOpen() || key < 0)
+		return;
+	beginRecord(RECORD_KEY);
+	write_pod(chunk, (int32_t)key);
+}
+
+// Mouse payload: window name length and bytes, event, x, y, flags.
+void FrameRecorder::mouse(const string& winName, int event, int x, int y, int flags)
+{
+	if (!isOpen())
+		return;
+	beginRecord(RECORD_MOUSE);
+	write_pod(chunk, (uint32_t)winName.size());
+	chunk.write(winName.data(), winName.size());
+	write_pod(chunk, (int32_t)event);
+	write_pod(chunk, (int32_t)x);
+	write_pod(chunk, (int32_t)y);
+	write_pod(chunk, (int32_t)flags);
+}
+
+void FrameRecorder::onMouse(int event, int x, int y, int flags, void* hook)
+{
+	const Hook* h = (const Hook*)hook;
+	h->recorder->mouse(h->winName, event, x, y, flags);
+	if (h->callback)
+		h->callback(event, x, y, flags, h->userdata);
+}
+
+void FrameRecorder::hookMouse(const string& winName, MouseCallback callback, void* userdata)
+{
+	Hook& h = hooks[winName];
+	h.recorder = this;
+	h.winName = winName;
+	h.callback = callback;
+	h.userdata = userdata;
+	cv::setMouseCallback(winName, onMouse, &h);
+}
+
+void FrameRecorder::unhookMouse(const string& winName)
+{
+	if (hooks.erase(winName))
+		cv::setMouseCallback(winName, NULL, NULL);
+}
+
+// Chunk layout: record count, byte count, records.
+void FrameRecorder::flush()
+{
+	if (!isOpen() || chunkRecords == 0)
+		return;
+	const string bytes = chunk.str();
+	write_pod(out, chunkRecords);
+	write_pod(out, (uint32_t)bytes.size());
+	out.write(bytes.data(), bytes.size());
+	out.flush();
+	chunk.str(string());
+	chunkRecords = 0;
+	framesInChunk = 0;
+}
+
+FrameReplayer::FrameReplayer(const string& fileName, bool realtime)
+	: in(fileName.c_str(), ios::binary), chunkRemaining(0), opened(false), realtime(realtime),
+	  havePending(false), firstTimestampUs(-1)
+{
+	char magic[sizeof(RECORDING_MAGIC)];
+	if (!in.read(magic, sizeof(magic)) || !equal(magic, magic + sizeof(magic), RECORDING_MAGIC))
+	{
+		cerr << "Not a recording: " << fileName << endl;
+		return;
+	}
+	opened = true;
+	havePending = readEvent(pending);
+}
+
+bool FrameReplayer::readChunk()
+{
+	uint32_t records, bytes;
+	if (!read_pod(in, records) || !read_pod(in, bytes))
+		return false;
+	string data(bytes, '\0');
+	if (bytes && !in.read(&data[0], bytes))
+		return false;
+	chunk.clear();
+	chunk.str(data);
+	chunkRemaining = records;
+	return true;
+}
+
+bool FrameReplayer::readEvent(Event& e)
+{
+	while (chunkRemaining == 0)
+		if (!readChunk())
+			return false;
+	chunkRemaining--;
+
+	if (!read_pod(chunk, e.type) || !read_pod(chunk, e.timestampUs))
+		return false;
+	e.frame.release();
+	e.window.clear();
+	if (e.type == RECORD_KEY)
+		return read_pod(chunk, e.values[0]);
+	if (e.type == RECORD_MOUSE)
+	{
+		uint32_t length;
+		if (!read_pod(chunk, length) || length > 4096)
+			return false;
+		e.window.resize(length);
+		if (length && !chunk.read(&e.window[0], length))
+			return false;
+	}
+	if (e.type == RECORD_MOUSE)
+		return read_pod(chunk, e.values[0]) && read_pod(chunk, e.values[1]) &&
+			read_pod(chunk, e.values[2]) && read_pod(chunk, e.values[3]);
+	if (e.type != RECORD_FRAME)
+		return false;
+
+	int32_t rows, cols, type, encoding;
+	uint32_t bytes;
+	if (!read_pod(chunk, rows) || !read_pod(chunk, cols) || !read_pod(chunk, type) ||
+		!read_pod(chunk, encoding) || !read_pod(chunk, bytes))
+		return false;
+	vector<uchar> data(bytes);
+	if (bytes && !chunk.read((char*)&data[0], bytes))
+		return false;
+	if (encoding == ENCODING_PNG)
+		e.frame = imdecode(data, IMREAD_UNCHANGED);
+	else if (bytes == (uint32_t)rows * cols * CV_ELEM_SIZE(type))
+		Mat(rows, cols, type, &data[0]).copyTo(e.frame);
+	return !e.frame.empty();
+}
+
+Mat FrameReplayer::next()
+{
+	// events of the previous frame that nobody asked for are dropped
+	events.clear();
+	Mat frame;
+	while (havePending && frame.empty())
+	{
+		if (pending.type == RECORD_FRAME)
+			frame = pending.frame;
+		Event current = pending;
+		havePending = readEvent(pending);
+		if (frame.empty())
+			continue;
+
+		// collect the key and mouse events recorded after this frame
+		while (havePending && pending.type != RECORD_FRAME)
+		{
+			events.push_back(pending);
+			havePending = readEvent(pending);
+		}
+
+		if (realtime)
+		{
+			if (firstTimestampUs < 0)
+			{
+				firstTimestampUs = current.timestampUs;
+				start = chrono::steady_clock::now();
+			}
+			this_thread::sleep_until(start + chrono::microseconds(current.timestampUs - firstTimestampUs));
+		}
+	}
+	return frame;
+}
+
+int FrameReplayer::waitKey()
+{
+	int key = -1;
+	while (!events.empty() && key < 0)
+	{
+		const Event& e = events.front();
+		if (e.type == RECORD_MOUSE)
+		{
+			auto it = callbacks.find(e.window);
+			if (it != callbacks.end() && it->second.first)
+				it->second.first(e.values[0], e.values[1], e.values[2], e.values[3], it->second.second);
+		}
+		else if (e.type == RECORD_KEY)
+			key = e.values[0];
+		events.pop_front();
+	}
+	return key;
+}
+
+void FrameReplayer::setMouseCallback(const string& winName, MouseCallback callback, void* userdata)
+{
+	callbacks[winName] = make_pair(callback, userdata);
+}
+
+void FrameReplayer::removeMouseCallback(const string& winName)
+{
+	callbacks.erase(winName);
+}
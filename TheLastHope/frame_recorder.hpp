@@ -0,0 +1,104 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+#include <opencv2/highgui.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Records a live session (raw frames with their timestamps, plus the keys returned by waitKey
+// and the mouse events of each window) so it can be replayed offline exactly as it ran.
+// The file is a "FRR1" header followed by chunks of records; a chunk is written every
+// `chunkFrames` frames, so a crash loses at most one chunk. Frames are stored raw or as
+// fast PNG (lossless).
+class FrameRecorder
+{
+public:
+	FrameRecorder(const string& fileName, bool compress = true, int chunkFrames = 30);
+	~FrameRecorder();
+
+	bool isOpen() const { return (bool)out; }
+
+	void frame(const Mat& image);
+	void key(int key);
+	void mouse(const string& winName, int event, int x, int y, int flags);
+
+	// Mouse callback of winName recording the event and then forwarding it to the wrapped
+	// callback; every window has its own. unhookMouse removes it again.
+	void hookMouse(const string& winName, MouseCallback callback, void* userdata);
+	void unhookMouse(const string& winName);
+
+private:
+	struct Hook
+	{
+		FrameRecorder* recorder;
+		string winName;
+		MouseCallback callback;
+		void* userdata;
+	};
+
+	void beginRecord(uint8_t type);
+	void flush();
+	static void onMouse(int event, int x, int y, int flags, void* hook);
+
+	ofstream out;
+	ostringstream chunk;
+	uint32_t chunkRecords;
+	int chunkFrames;
+	int framesInChunk;
+	bool compress;
+	uint64_t frameCount;
+	chrono::steady_clock::time_point start;
+	map<string, Hook> hooks;   // the nodes stay put, OpenCV holds pointers to them
+};
+
+// Plays back a FrameRecorder file. next() returns the recorded frames in order, at the
+// recorded pace or as fast as possible; waitKey() dispatches the mouse events recorded
+// after the current frame to the callback registered for their window and returns the
+// recorded key.
+class FrameReplayer
+{
+public:
+	FrameReplayer(const string& fileName, bool realtime = true);
+
+	bool isOpen() const { return opened; }
+
+	Mat next();
+	int waitKey();
+	void setMouseCallback(const string& winName, MouseCallback callback, void* userdata);
+	void removeMouseCallback(const string& winName);
+
+private:
+	struct Event
+	{
+		uint8_t type;
+		int64_t timestampUs;
+		int32_t values[4];   // key, or mouse event, x, y, flags
+		string window;       // of a mouse event
+		Mat frame;
+	};
+
+	bool readEvent(Event& e);
+	bool readChunk();
+
+	ifstream in;
+	istringstream chunk;
+	uint32_t chunkRemaining;
+	bool opened;
+	bool realtime;
+	bool havePending;
+	Event pending;            // lookahead: the next frame
+	deque<Event> events;      // key and mouse events of the current frame
+	int64_t firstTimestampUs;
+	chrono::steady_clock::time_point start;
+	map<string, pair<MouseCallback, void*> > callbacks;
+};
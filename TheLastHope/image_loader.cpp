@@ -0,0 +1,96 @@
+#include <algorithm>
+#include "image_loader.hpp"
+
+using namespace cv;
+using namespace std;
+
+int reduced_imread_flag(int reduction, bool color)
+{
+	switch (reduction)
+	{
+	case 2: return color ? IMREAD_REDUCED_COLOR_2 : IMREAD_REDUCED_GRAYSCALE_2;
+	case 4: return color ? IMREAD_REDUCED_COLOR_4 : IMREAD_REDUCED_GRAYSCALE_4;
+	case 8: return color ? IMREAD_REDUCED_COLOR_8 : IMREAD_REDUCED_GRAYSCALE_8;
+	default: return color ? IMREAD_COLOR : IMREAD_GRAYSCALE;
+	}
+}
+
+ImagePrefetcher::ImagePrefetcher(const vector<string>& paths, int flags, int threads, size_t depth, bool keepDecoded)
+	: paths(paths), flags(flags), nThreads(std::max(threads, 1)), depth(std::max(depth, (size_t)1)),
+	keepDecoded(keepDecoded), frames(paths.size()), states(paths.size(), PENDING),
+	next(0), cursor(0), stopping(false)
+{
+}
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+	{
+		unique_lock<mutex> guard(lock);
+		stopping = true;
+	}
+	workAvailable.notify_all();
+	for (thread& t : workers)
+		t.join();
+}
+
+// Workers are only spawned on the first request, so an unused list costs nothing
+void ImagePrefetcher::start()
+{
+	for (int i = 0; i < nThreads; i++)
+		workers.push_back(thread(&ImagePrefetcher::worker, this));
+}
+
+void ImagePrefetcher::worker()
+{
+	unique_lock<mutex> guard(lock);
+	for (;;)
+	{
+		workAvailable.wait(guard, [this] { return stopping || (next < paths.size() && next < cursor + depth); });
+		if (stopping)
+			return;
+
+		size_t index = next++;
+		if (states[index] != PENDING)
+			continue;
+		states[index] = DECODING;
+
+		guard.unlock();
+		Mat image = imread(paths[index], flags);
+		guard.lock();
+
+		frames[index] = image;
+		states[index] = READY;
+		frameReady.notify_all();
+	}
+}
+
+Mat ImagePrefetcher::get(size_t index)
+{
+	if (index >= paths.size())
+		return Mat();
+
+	unique_lock<mutex> guard(lock);
+	if (workers.empty())
+		start();
+
+	cursor = std::max(cursor, index);
+	if (index > next)
+		next = index;   // jumped ahead of the workers: skip what was never asked for
+	workAvailable.notify_all();
+
+	if (states[index] == RELEASED || (states[index] == PENDING && index < next))
+	{
+		// consumed earlier without keeping it, or skipped over: decode here
+		guard.unlock();
+		return imread(paths[index], flags);
+	}
+
+	frameReady.wait(guard, [&] { return states[index] == READY; });
+	if (keepDecoded)
+		return frames[index].clone();
+
+	Mat image = frames[index];
+	frames[index].release();
+	states[index] = RELEASED;
+	return image;
+}
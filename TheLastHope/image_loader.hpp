@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+using namespace cv;
+using namespace std;
+
+// imread flag decoding an image directly at 1/reduction of its size (reduction = 1, 2, 4 or 8)
+int reduced_imread_flag(int reduction, bool color = true);
+
+// Decodes an image list ahead of the consumer on background threads. At most `depth` images
+// past the last requested one are decoded, which bounds the memory. Consumed images are
+// released unless keepDecoded is set, in which case a later pass over the list (e.g. the
+// undistortion review) gets them without decoding again. Kept images are handed out as
+// copies, so the consumer may draw on what it gets.
+class ImagePrefetcher
+{
+public:
+	ImagePrefetcher(const vector<string>& paths, int flags = IMREAD_COLOR, int threads = 2,
+		size_t depth = 8, bool keepDecoded = false);
+	~ImagePrefetcher();
+
+	size_t size() const { return paths.size(); }
+
+	// Blocks until image `index` is decoded; an empty Mat if it cannot be read
+	Mat get(size_t index);
+
+private:
+	enum SlotState { PENDING, DECODING, READY, RELEASED };
+
+	void start();
+	void worker();
+
+	vector<string> paths;
+	int flags;
+	int nThreads;
+	size_t depth;
+	bool keepDecoded;
+
+	vector<Mat> frames;
+	vector<SlotState> states;
+	size_t next;    // next index to hand to a worker
+	size_t cursor;  // last index requested by the consumer
+	bool stopping;
+
+	mutex lock;
+	condition_variable workAvailable;
+	condition_variable frameReady;
+	vector<thread> workers;
+};
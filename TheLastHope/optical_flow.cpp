@@ -1,13 +1,104 @@
 #include <iostream>
+#include <cstdio>
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
+#include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/videoio.hpp>
 #include <opencv2/video.hpp>
+#include "dense_flow.hpp"
+#include "stabilizer.hpp"
+#include "frame_pool.hpp"
 
 using namespace cv;
 using namespace std;
 
+// Hue = direction, value = speed (saturating at maxSpeed pixels per frame)
+static void drawFlow(const Mat& flow, const Mat& valid, Mat& image, float maxSpeed = 20)
+{
+    Mat parts[2], magnitude, angle;
+    split(flow, parts);
+    cartToPolar(parts[0], parts[1], magnitude, angle, true);
+
+    Mat hsv[3];
+    angle.convertTo(hsv[0], CV_8U, 0.5);
+    hsv[1] = Mat(flow.size(), CV_8U, Scalar(255));
+    magnitude.convertTo(hsv[2], CV_8U, 255. / maxSpeed);
+    hsv[2].setTo(Scalar(0), valid == 0);
+
+    Mat merged;
+    merge(hsv, 3, merged);
+    cvtColor(merged, image, COLOR_HSV2BGR);
+}
+
+// Dense flow of the whole video, see TiledDenseFlow; the fields are shown and optionally
+// written to a quantized flow stream
+static int denseFlow(VideoCapture& capture, const CommandLineParser& parser)
+{
+    TiledDenseFlow::Method method = parser.get<string>("method") == "farneback" ? TiledDenseFlow::FARNEBACK
+                                                                                : TiledDenseFlow::DIS;
+    TiledDenseFlow dense(method, parser.get<double>("scale"), parser.get<int>("bands"));
+
+    Rect roi;
+    const string roiText = parser.get<string>("roi");
+    if (!roiText.empty() && sscanf(roiText.c_str(), "%d,%d,%d,%d", &roi.x, &roi.y, &roi.width, &roi.height) != 4)
+    {
+        cerr << "Invalid region " << roiText << ", expected x,y,width,height" << endl;
+        return 0;
+    }
+    Mat mask;
+    const string maskFile = parser.get<string>("mask");
+    if (!maskFile.empty())
+    {
+        mask = imread(maskFile, IMREAD_GRAYSCALE);
+        if (mask.empty())
+        {
+            cerr << "Unable to read the mask " << maskFile << endl;
+            return 0;
+        }
+    }
+
+    Mat frame, prevGray, gray, flow, valid, shown;
+    capture >> frame;
+    if (frame.empty())
+        return 0;
+    cvtColor(frame, prevGray, COLOR_BGR2GRAY);
+    if (!mask.empty() && mask.size() != prevGray.size())
+        resize(mask, mask, prevGray.size(), 0, 0, INTER_NEAREST);
+
+    const string flowFile = parser.get<string>("flow_out");
+    Ptr<FlowWriter> writer;
+    uint32_t frameIndex = 1;
+    while (true)
+    {
+        capture >> frame;
+        if (frame.empty())
+            break;
+        cvtColor(frame, gray, COLOR_BGR2GRAY);
+
+        int64 start = getTickCount();
+        dense.compute(prevGray, gray, flow, valid, roi, mask);
+        double ms = (getTickCount() - start) * 1000. / getTickFrequency();
+
+        if (!writer && !flowFile.empty())
+            writer = makePtr<FlowWriter>(flowFile, flow.size(), parser.get<float>("flow_step"));
+        if (writer)
+            writer->write(frameIndex, flow, valid);
+
+        drawFlow(flow, valid, shown);
+        putText(shown, format("%.1f ms", ms), Point(10, 20), FONT_HERSHEY_PLAIN, 1, Scalar(255, 255, 255));
+        imshow("Flow", shown);
+
+        int keyboard = waitKey(1);
+        if (keyboard == 'q' || keyboard == 27)
+            break;
+
+        std::swap(prevGray, gray);
+        frameIndex++;
+    }
+    return 0;
+}
+
 int main2(int argc, char **argv)
 {
     const string about =
@@ -16,7 +107,19 @@ int main2(int argc, char **argv)
         "  https://www.bogotobogo.com/python/OpenCV_Python/images/mean_shift_tracking/slow_traffic_small.mp4";
     const string keys =
         "{ h help |      | print this help message }"
-        "{ @image | vtest.avi | path to image file }";
+        "{ @image | vtest.avi | path to image file }"
+        "{ dense     |        | dense optical flow instead of tracking corners }"
+        "{ method    | dis    | dense flow algorithm: dis or farneback }"
+        "{ scale     | 0.5    | resolution of the dense flow, as a fraction of the input }"
+        "{ bands     | 0      | horizontal bands computed in parallel (0 = one per thread) }"
+        "{ roi       |        | only compute the dense flow in x,y,width,height }"
+        "{ mask      |        | only compute the dense flow where this image is not zero }"
+        "{ flow_out  |        | write the dense flow fields to this file }"
+        "{ flow_step | 0.0625 | quantization step of the written flow, in pixels }"
+        "{ stabilize |        | stabilize the video on the tracked corners }"
+        "{ smoothing | 30     | frames over which the camera path is smoothed }"
+        "{ zoom      | 1.05   | zoom of the stabilized video, hiding the moving borders }"
+        "{ stabilized_out |   | write the stabilized video to this file }";
     CommandLineParser parser(argc, argv, keys);
     parser.about(about);
     if (parser.has("help"))
@@ -38,6 +141,9 @@ int main2(int argc, char **argv)
         return 0;
     }
 
+    if (parser.has("dense"))
+        return denseFlow(capture, parser);
+
     // Create some random colors
     vector<Scalar> colors;
     RNG rng;
@@ -60,8 +166,28 @@ int main2(int argc, char **argv)
     // Create a mask image for drawing purposes
     Mat mask = Mat::zeros(old_frame.size(), old_frame.type());
 
+    // Stabilization needs corners all the time: they are searched for again whenever
+    // fewer than half of them are still tracked
+    const bool stabilize = parser.has("stabilize");
+    const double zoom = parser.get<double>("zoom");
+    Stabilizer stabilizer(parser.get<int>("smoothing"));
+    VideoWriter stabilizedOut;
+    const string stabilizedFile = parser.get<string>("stabilized_out");
+    if (stabilize && !stabilizedFile.empty())
+    {
+        double fps = capture.get(CAP_PROP_FPS);
+        stabilizedOut.open(stabilizedFile, VideoWriter::fourcc('M', 'J', 'P', 'G'), fps > 0 ? fps : 30, old_frame.size());
+        if (!stabilizedOut.isOpened())
+            cerr << "Unable to create " << stabilizedFile << endl;
+    }
+
+    // frames, gray frames and overlays are recycled: capture, cvtColor and add write into
+    // pooled buffers of the right format instead of allocating
+    FramePool pool("optical flow", 8);
+
     while(true){
-        Mat frame, frame_gray;
+        Mat frame = pool.get(old_frame.size(), old_frame.type());
+        Mat frame_gray = pool.get(old_frame.size(), CV_8UC1);
 
         capture >> frame;
         if (frame.empty())
@@ -74,28 +200,51 @@ int main2(int argc, char **argv)
         TermCriteria criteria = TermCriteria((TermCriteria::COUNT) + (TermCriteria::EPS), 10, 0.03);
         calcOpticalFlowPyrLK(old_gray, frame_gray, p0, p1, status, err, Size(15,15), 2, criteria);
 
-        vector<Point2f> good_new;
+        vector<Point2f> good_old, good_new;
+        vector<Scalar> good_colors;
         for(uint i = 0; i < p0.size(); i++)
         {
             // Select good points
             if(status[i] == 1) {
+                good_old.push_back(p0[i]);
                 good_new.push_back(p1[i]);
-                // draw the tracks
-                line(mask,p1[i], p0[i], colors[i], 2);
-                circle(frame, p1[i], 5, colors[i], -1);
+                good_colors.push_back(colors[i]);
             }
         }
-        Mat img;
+
+        // the stabilized frame must not show the tracks
+        if (stabilize)
+        {
+            Mat stabilized = pool.get(frame.size(), frame.type());
+            stabilizer.update(good_old, good_new);
+            stabilizer.stabilize(frame, stabilized, zoom);
+            imshow("Stabilized", stabilized);
+            if (stabilizedOut.isOpened())
+                stabilizedOut << stabilized;
+        }
+
+        for (size_t i = 0; i < good_new.size(); i++)
+        {
+            // draw the tracks
+            line(mask, good_new[i], good_old[i], good_colors[i], 2);
+            circle(frame, good_new[i], 5, good_colors[i], -1);
+        }
+        Mat img = pool.get(frame.size(), frame.type());
         add(frame, mask, img);
 
         imshow("Frame", img);
 
-        int keyboard = waitKey(30);
+        int keyboard = waitKey(stabilize ? 1 : 30);
         if (keyboard == 'q' || keyboard == 27)
             break;
 
         // Now update the previous frame and previous points
-        old_gray = frame_gray.clone();
+        old_gray = frame_gray;
         p0 = good_new;
+        if (stabilize && p0.size() < 50)
+        {
+            goodFeaturesToTrack(old_gray, p0, 100, 0.3, 7, Mat(), 7, false, 0.04);
+            mask.setTo(Scalar::all(0));
+        }
     }
 }
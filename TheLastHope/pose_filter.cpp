@@ -0,0 +1,93 @@
+#include <cmath>
+#include "pose_filter.hpp"
+
+using namespace cv;
+using namespace std;
+
+// Diagonal covariance over the state or measurement blocks: rotation terms get variance,
+// translation terms variance * translationScale
+static void set_block_covariance(Mat& cov, double variance, double translationScale)
+{
+	cov = Mat::zeros(cov.rows, cov.cols, CV_64F);
+	for (int i = 0; i < cov.rows; i++)
+		cov.at<double>(i, i) = i % 6 < 3 ? variance : variance * translationScale;
+}
+
+PoseFilter::PoseFilter(double processNoise, double measurementNoise, int maxPredicted, double translationUnit)
+	: kf(12, 6, 0, CV_64F), processNoise(processNoise), translationScale(translationUnit * translationUnit),
+	  maxPredicted(maxPredicted), sinceMeasurement(0), initialised(false)
+{
+	kf.measurementMatrix = Mat::eye(6, 12, CV_64F);
+	set_block_covariance(kf.measurementNoiseCov, measurementNoise, translationScale);
+}
+
+void PoseFilter::reset()
+{
+	initialised = false;
+	sinceMeasurement = 0;
+}
+
+bool PoseFilter::predict(double dt, Vec3d& rvec, Vec3d& tvec)
+{
+	if (!initialised)
+		return false;
+
+	setIdentity(kf.transitionMatrix);
+	for (int i = 0; i < 6; i++)
+		kf.transitionMatrix.at<double>(i, i + 6) = dt;
+	set_block_covariance(kf.processNoiseCov, processNoise * std::max(dt, 1e-3), translationScale);
+
+	const Mat& x = kf.predict();
+	rvec = Vec3d(x.at<double>(0), x.at<double>(1), x.at<double>(2));
+	tvec = Vec3d(x.at<double>(3), x.at<double>(4), x.at<double>(5));
+	return true;
+}
+
+bool PoseFilter::coast()
+{
+	if (!initialised)
+		return false;
+	if (++sinceMeasurement > maxPredicted)
+	{
+		reset();
+		return false;
+	}
+	return true;
+}
+
+// The same rotation as r, with the rotation vector picked closest to ref. Near an angle of pi
+// solvePnP may return either r or its 2*pi complement, which would look like a huge jump.
+static Vec3d closest_rvec(const Vec3d& r, const Vec3d& ref)
+{
+	const double angle = norm(r);
+	if (angle < 1e-9)
+		return r;
+	Vec3d alt = r * (1 - 2 * CV_PI / angle);
+	return norm(alt - ref) < norm(r - ref) ? alt : r;
+}
+
+void PoseFilter::correct(const Vec3d& rvec, const Vec3d& tvec, Vec3d& filteredRvec, Vec3d& filteredTvec)
+{
+	sinceMeasurement = 0;
+	if (!initialised)
+	{
+		kf.statePost = Mat::zeros(12, 1, CV_64F);
+		for (int i = 0; i < 3; i++)
+		{
+			kf.statePost.at<double>(i) = rvec[i];
+			kf.statePost.at<double>(i + 3) = tvec[i];
+		}
+		set_block_covariance(kf.errorCovPost, 1, translationScale);
+		initialised = true;
+		filteredRvec = rvec;
+		filteredTvec = tvec;
+		return;
+	}
+
+	const Mat& prior = kf.statePre;
+	Vec3d r = closest_rvec(rvec, Vec3d(prior.at<double>(0), prior.at<double>(1), prior.at<double>(2)));
+	Mat measurement = (Mat_<double>(6, 1) << r[0], r[1], r[2], tvec[0], tvec[1], tvec[2]);
+	const Mat& x = kf.correct(measurement);
+	filteredRvec = Vec3d(x.at<double>(0), x.at<double>(1), x.at<double>(2));
+	filteredTvec = Vec3d(x.at<double>(3), x.at<double>(4), x.at<double>(5));
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/video/tracking.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Constant-velocity Kalman filter over the board pose (rotation vector and translation).
+// predict() gives the pose expected in the next frame, which seeds solvePnP and narrows the
+// board search; correct() folds in a measured pose and returns the smoothed one. A frame that
+// ends without a measurement calls coast() instead: through a dropout the prediction stands in
+// for the pose for maxPredicted frames, after which the filter starts over.
+// The noise levels are variances in radians for the rotation and in translationUnit (e.g. the
+// board square size) for the translation, so both are smoothed alike whatever the units.
+class PoseFilter
+{
+public:
+	PoseFilter(double processNoise = 1e-2, double measurementNoise = 1e-3, int maxPredicted = 5,
+		double translationUnit = 1);
+
+	// Advances the filter by dt seconds; false when there is no usable prediction
+	bool predict(double dt, Vec3d& rvec, Vec3d& tvec);
+	void correct(const Vec3d& rvec, const Vec3d& tvec, Vec3d& filteredRvec, Vec3d& filteredTvec);
+	// Ends a frame without a measurement; false once the prediction may no longer be reported
+	bool coast();
+	void reset();
+
+private:
+	KalmanFilter kf;         // state: rvec, tvec and their rates of change
+	double processNoise;
+	double translationScale; // translationUnit squared, scales the variances of the translation terms
+	int maxPredicted;
+	int sinceMeasurement;    // frames ended without a measurement since the last one
+	bool initialised;
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Allocation-free rotation helpers on fixed-size types. The batch versions run over plain
+// arrays of poses so a whole trajectory converts in one tight loop.
+
+// R^T R == I within eps, checked on the six distinct dot products of the columns
+inline bool isRotationMatrix(const Matx33d& R, double eps = 1e-6)
+{
+	double err = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = i; j < 3; j++)
+		{
+			double d = R(0, i) * R(0, j) + R(1, i) * R(1, j) + R(2, i) * R(2, j) - (i == j ? 1 : 0);
+			err += (i == j ? 1 : 2) * d * d;
+		}
+	}
+	return err < eps * eps;
+}
+
+// Tait-Bryan angles (roll about x, pitch about y, yaw about z, R = Rz * Ry * Rx) in radians
+inline Vec3d rot2euler(const Matx33d& R)
+{
+	if (R(2, 0) < 1)
+	{
+		if (R(2, 0) > -1)
+			return Vec3d(std::atan2(R(2, 1), R(2, 2)), std::asin(-R(2, 0)), std::atan2(R(1, 0), R(0, 0)));
+		// R(2,0) = -1, not unique: x - z = atan2(-R(1,2), R(1,1))
+		return Vec3d(0, CV_PI / 2, -std::atan2(-R(1, 2), R(1, 1)));
+	}
+	// R(2,0) = +1, not unique: x + z = atan2(-R(1,2), R(1,1))
+	return Vec3d(0, -CV_PI / 2, std::atan2(-R(1, 2), R(1, 1)));
+}
+
+// Rotation vector (axis * angle) to matrix, closed-form Rodrigues formula
+inline Matx33d rodrigues(const Vec3d& r)
+{
+	const double theta = std::sqrt(r.dot(r));
+	if (theta < 1e-12)
+		return Matx33d(1, -r[2], r[1], r[2], 1, -r[0], -r[1], r[0], 1);
+
+	const double c = std::cos(theta), s = std::sin(theta), c1 = 1 - c;
+	const double x = r[0] / theta, y = r[1] / theta, z = r[2] / theta;
+	return Matx33d(c + c1 * x * x, c1 * x * y - s * z, c1 * x * z + s * y,
+	               c1 * y * x + s * z, c + c1 * y * y, c1 * y * z - s * x,
+	               c1 * z * x - s * y, c1 * z * y + s * x, c + c1 * z * z);
+}
+
+// Unit quaternion (w, x, y, z) of a rotation matrix, Shepperd's method
+inline Vec4d rot2quat(const Matx33d& R)
+{
+	const double tr = R(0, 0) + R(1, 1) + R(2, 2);
+	Vec4d q;
+	if (tr > 0)
+	{
+		double s = 2 * std::sqrt(tr + 1);
+		q = Vec4d(s / 4, (R(2, 1) - R(1, 2)) / s, (R(0, 2) - R(2, 0)) / s, (R(1, 0) - R(0, 1)) / s);
+	}
+	else if (R(0, 0) > R(1, 1) && R(0, 0) > R(2, 2))
+	{
+		double s = 2 * std::sqrt(1 + R(0, 0) - R(1, 1) - R(2, 2));
+		q = Vec4d((R(2, 1) - R(1, 2)) / s, s / 4, (R(0, 1) + R(1, 0)) / s, (R(0, 2) + R(2, 0)) / s);
+	}
+	else if (R(1, 1) > R(2, 2))
+	{
+		double s = 2 * std::sqrt(1 + R(1, 1) - R(0, 0) - R(2, 2));
+		q = Vec4d((R(0, 2) - R(2, 0)) / s, (R(0, 1) + R(1, 0)) / s, s / 4, (R(1, 2) + R(2, 1)) / s);
+	}
+	else
+	{
+		double s = 2 * std::sqrt(1 + R(2, 2) - R(0, 0) - R(1, 1));
+		q = Vec4d((R(1, 0) - R(0, 1)) / s, (R(0, 2) + R(2, 0)) / s, (R(1, 2) + R(2, 1)) / s, s / 4);
+	}
+	return q[0] < 0 ? -q : q;
+}
+
+inline Matx33d quat2rot(const Vec4d& q)
+{
+	const double w = q[0], x = q[1], y = q[2], z = q[3];
+	return Matx33d(1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y),
+	               2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x),
+	               2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y));
+}
+
+// Rotation vector of a quaternion and of a matrix (through its quaternion, stable near 0 and pi)
+inline Vec3d quat2rvec(const Vec4d& q)
+{
+	const double n = std::sqrt(q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	if (n < 1e-12)
+		return Vec3d(2 * q[1], 2 * q[2], 2 * q[3]);
+	const double k = 2 * std::atan2(n, q[0]) / n;
+	return Vec3d(k * q[1], k * q[2], k * q[3]);
+}
+
+inline Vec3d rot2rvec(const Matx33d& R)
+{
+	return quat2rvec(rot2quat(R));
+}
+
+inline Vec3d rad2deg(const Vec3d& a)
+{
+	return a * (180 / CV_PI);
+}
+
+// Batch conversions over n poses
+inline void rvecs2euler(const Vec3d* rvecs, Vec3d* euler, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		euler[i] = rot2euler(rodrigues(rvecs[i]));
+}
+
+inline void rvecs2quat(const Vec3d* rvecs, Vec4d* quats, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		quats[i] = rot2quat(rodrigues(rvecs[i]));
+}
+
+inline void quats2rvecs(const Vec4d* quats, Vec3d* rvecs, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		rvecs[i] = quat2rvec(quats[i]);
+}
+
+inline void rvecs2euler(const vector<Vec3d>& rvecs, vector<Vec3d>& euler)
+{
+	euler.resize(rvecs.size());
+	if (!rvecs.empty())
+		rvecs2euler(&rvecs[0], &euler[0], rvecs.size());
+}
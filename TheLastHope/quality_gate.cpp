@@ -0,0 +1,63 @@
+#include <opencv2/imgproc.hpp>
+#include "quality_gate.hpp"
+
+using namespace cv;
+using namespace std;
+
+static const int WORK_WIDTH = 320;
+static const int DARK_LEVEL = 5;
+static const int BRIGHT_LEVEL = 250;
+
+QualityGate::QualityGate(double minSharpness, double maxClipped, double maxMotion)
+	: minSharpness(minSharpness), maxClipped(maxClipped), maxMotion(maxMotion)
+{
+}
+
+bool QualityGate::check(const Mat& frame, FrameQuality& quality)
+{
+	quality = FrameQuality();
+	if (!enabled() || frame.empty())
+		return true;
+
+	Mat gray, small;
+	if (frame.channels() == 1)
+		gray = frame;
+	else
+		cvtColor(frame, gray, COLOR_BGR2GRAY);
+	const double scale = std::min(1.0, (double)WORK_WIDTH / gray.cols);
+	if (scale < 1)
+		resize(gray, small, Size(), scale, scale, INTER_AREA);
+	else
+		small = gray.clone();
+
+	Mat laplacian;
+	Scalar mean, stddev;
+	Laplacian(small, laplacian, CV_16S);
+	meanStdDev(laplacian, mean, stddev);
+	quality.sharpness = stddev[0] * stddev[0];
+
+	int clippedPixels = 0;
+	for (int y = 0; y < small.rows; y++)
+	{
+		const uchar* row = small.ptr<uchar>(y);
+		for (int x = 0; x < small.cols; x++)
+			clippedPixels += row[x] <= DARK_LEVEL || row[x] >= BRIGHT_LEVEL;
+	}
+	quality.clipped = clippedPixels / (double)small.total();
+
+	if (previous.size() == small.size())
+	{
+		Mat diff;
+		absdiff(small, previous, diff);
+		quality.motion = cv::mean(diff)[0];
+	}
+	previous = small;
+
+	if (minSharpness > 0 && quality.sharpness < minSharpness)
+		quality.reason = "blurred";
+	else if (maxClipped > 0 && quality.clipped > maxClipped)
+		quality.reason = "exposure";
+	else if (maxMotion > 0 && quality.motion > maxMotion)
+		quality.reason = "motion";
+	return quality.reason == NULL;
+}
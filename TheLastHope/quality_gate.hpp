@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+#include <opencv2/core.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Measurements of one frame, on a gray copy reduced to about 320 pixels wide
+struct FrameQuality
+{
+	double sharpness;   // variance of the Laplacian
+	double clipped;     // fraction of the pixels under- or over-exposed
+	double motion;      // mean absolute gray difference to the previous frame (0 for the first one)
+	const char* reason; // why the frame was rejected, NULL if it passed
+};
+
+// Rejects frames not worth a pattern search: blurred (sharpness under minSharpness), badly
+// exposed (more than maxClipped of the pixels at the ends of the histogram) or shaken (motion
+// over maxMotion). A threshold of 0 disables its test. check() keeps the reduced frame for the
+// motion test, so frames must be checked in capture order.
+class QualityGate
+{
+public:
+	QualityGate(double minSharpness = 0, double maxClipped = 0, double maxMotion = 0);
+
+	bool enabled() const { return minSharpness > 0 || maxClipped > 0 || maxMotion > 0; }
+	bool check(const Mat& frame, FrameQuality& quality);
+
+private:
+	double minSharpness;
+	double maxClipped;
+	double maxMotion;
+	Mat previous;
+};
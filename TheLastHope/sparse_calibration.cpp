@@ -0,0 +1,272 @@
+#include <iostream>
+#include <algorithm>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/calib3d.hpp>
+#include "sparse_calibration.hpp"
+
+using namespace cv;
+using namespace std;
+
+// Intrinsics as one vector: fx, fy, cx, cy, then the distortion coefficients. Only the
+// `active` entries are solved for; with a fixed aspect ratio fy follows fx.
+struct Intrinsics
+{
+	vector<double> values;
+	vector<int> active;
+	bool fixAspect;
+	double aspect;      // fy / fx
+
+	int distortionCount() const { return (int)values.size() - 4; }
+
+	void toMats(Mat& cameraMatrix, Mat& distCoeffs) const
+	{
+		cameraMatrix = (Mat_<double>(3, 3) << values[0], 0, values[2], 0, values[1], values[3], 0, 0, 1);
+		distCoeffs = Mat(values, true).rowRange(4, (int)values.size()).clone();
+	}
+
+	void update(const Mat& delta)
+	{
+		for (size_t k = 0; k < active.size(); k++)
+			values[active[k]] += delta.at<double>((int)k);
+		if (fixAspect)
+			values[1] = values[0] * aspect;
+	}
+};
+
+// Everything one view contributes to the normal equations
+struct ViewBlock
+{
+	Mat V;      // 6x6 pose block
+	Mat W;      // intrinsics x 6 coupling block
+	Mat U;      // intrinsic block
+	Mat gp;     // pose gradient
+	Mat gc;     // intrinsic gradient
+	double err; // sum of squared residuals
+};
+
+static Mat residuals(const Mat& projected, const vector<Point2f>& imagePoints)
+{
+	Mat r, measured;
+	projected.reshape(1, (int)imagePoints.size() * 2).convertTo(r, CV_64F);
+	Mat(imagePoints).reshape(1, (int)imagePoints.size() * 2).convertTo(measured, CV_64F);
+	return r - measured;
+}
+
+static void viewBlock(const vector<Point3f>& objectPoints, const vector<Point2f>& imagePoints,
+	const Intrinsics& intr, const Mat& cameraMatrix, const Mat& distCoeffs,
+	const Mat& rvec, const Mat& tvec, ViewBlock& b)
+{
+	Mat projected, J;
+	projectPoints(objectPoints, rvec, tvec, cameraMatrix, distCoeffs, projected, J);
+	Mat r = residuals(projected, imagePoints);
+
+	// projectPoints orders its jacobian columns as rvec, tvec, fx, fy, cx, cy, distortion
+	Mat Jp = J.colRange(0, 6);
+	Mat Jc(J.rows, (int)intr.active.size(), CV_64F);
+	for (size_t k = 0; k < intr.active.size(); k++)
+	{
+		Mat col = J.col(6 + intr.active[k]);
+		if (intr.active[k] == 0 && intr.fixAspect)
+			col = col + intr.aspect * J.col(7);
+		col.copyTo(Jc.col((int)k));
+	}
+
+	mulTransposed(Jp, b.V, true);
+	mulTransposed(Jc, b.U, true);
+	b.W = Jc.t() * Jp;
+	b.gp = Jp.t() * r;
+	b.gc = Jc.t() * r;
+	b.err = r.dot(r);
+}
+
+static double viewError(const vector<Point3f>& objectPoints, const vector<Point2f>& imagePoints,
+	const Mat& cameraMatrix, const Mat& distCoeffs, const Mat& rvec, const Mat& tvec)
+{
+	Mat projected;
+	projectPoints(objectPoints, rvec, tvec, cameraMatrix, distCoeffs, projected);
+	Mat r = residuals(projected, imagePoints);
+	return r.dot(r);
+}
+
+static Mat damped(const Mat& block, double lambda)
+{
+	Mat d = block.clone();
+	for (int i = 0; i < d.rows; i++)
+		d.at<double>(i, i) += lambda * d.at<double>(i, i) + 1e-12;
+	return d;
+}
+
+double calibrateCameraSparse(const vector<vector<Point3f> >& objectPoints,
+	const vector<vector<Point2f> >& imagePoints, Size imageSize, Mat& cameraMatrix, Mat& distCoeffs,
+	vector<Mat>& rvecs, vector<Mat>& tvecs, Mat& stdDeviations, int flags, TermCriteria criteria, int initViews)
+{
+	CV_Assert(!objectPoints.empty() && objectPoints.size() == imagePoints.size());
+	const int nViews = (int)objectPoints.size();
+
+	// intrinsics from a subset spread over all the views
+	vector<vector<Point3f> > initObject;
+	vector<vector<Point2f> > initImage;
+	const int nInit = std::min(nViews, std::max(initViews, 3));
+	for (int k = 0; k < nInit; k++)
+	{
+		const int i = (int)((int64)k * nViews / nInit);
+		initObject.push_back(objectPoints[i]);
+		initImage.push_back(imagePoints[i]);
+	}
+	vector<Mat> initR, initT;
+	calibrateCamera(initObject, initImage, imageSize, cameraMatrix, distCoeffs, initR, initT, flags | CALIB_USE_LU);
+
+	Intrinsics intr;
+	const int nDist = flags & CALIB_RATIONAL_MODEL ? 8 : 5;
+	Mat D;
+	distCoeffs.convertTo(D, CV_64F);
+	D = D.reshape(1, (int)D.total());
+	intr.values = { cameraMatrix.at<double>(0, 0), cameraMatrix.at<double>(1, 1),
+		cameraMatrix.at<double>(0, 2), cameraMatrix.at<double>(1, 2) };
+	for (int k = 0; k < nDist; k++)
+		intr.values.push_back(k < D.rows ? D.at<double>(k) : 0.);
+	intr.fixAspect = (flags & CALIB_FIX_ASPECT_RATIO) != 0;
+	intr.aspect = intr.values[1] / intr.values[0];
+
+	// distortion order: k1 k2 p1 p2 k3 [k4 k5 k6]
+	const int fixedDistortion[] = { CALIB_FIX_K1, CALIB_FIX_K2, 0, 0, CALIB_FIX_K3, CALIB_FIX_K4, CALIB_FIX_K5, CALIB_FIX_K6 };
+	intr.active.push_back(0);
+	if (!intr.fixAspect)
+		intr.active.push_back(1);
+	if (!(flags & CALIB_FIX_PRINCIPAL_POINT))
+	{
+		intr.active.push_back(2);
+		intr.active.push_back(3);
+	}
+	for (int k = 0; k < nDist; k++)
+	{
+		const bool tangential = k == 2 || k == 3;
+		if ((tangential && (flags & CALIB_ZERO_TANGENT_DIST)) || (fixedDistortion[k] & flags))
+			continue;
+		intr.active.push_back(4 + k);
+	}
+	const int nc = (int)intr.active.size();
+
+	// every pose from the initial intrinsics
+	rvecs.assign(nViews, Mat());
+	tvecs.assign(nViews, Mat());
+	intr.toMats(cameraMatrix, distCoeffs);
+	parallel_for_(Range(0, nViews), [&](const Range& range)
+	{
+		for (int i = range.start; i < range.end; i++)
+		{
+			Mat r, t;
+			solvePnP(objectPoints[i], imagePoints[i], cameraMatrix, distCoeffs, r, t);
+			r.convertTo(rvecs[i], CV_64F);
+			t.convertTo(tvecs[i], CV_64F);
+		}
+	});
+
+	size_t totalPoints = 0;
+	for (const vector<Point2f>& v : imagePoints)
+		totalPoints += v.size();
+
+	vector<ViewBlock> blocks(nViews);
+	auto linearize = [&]() -> double
+	{
+		parallel_for_(Range(0, nViews), [&](const Range& range)
+		{
+			for (int i = range.start; i < range.end; i++)
+				viewBlock(objectPoints[i], imagePoints[i], intr, cameraMatrix, distCoeffs, rvecs[i], tvecs[i], blocks[i]);
+		});
+		double err = 0;
+		for (const ViewBlock& b : blocks)
+			err += b.err;
+		return err;
+	};
+
+	// Schur complement of the (damped) pose blocks: S = U - sum W V^-1 W^T, and its right hand side
+	vector<Mat> Vinv(nViews);
+	auto reduce = [&](double lambda, Mat& S, Mat& rhs)
+	{
+		parallel_for_(Range(0, nViews), [&](const Range& range)
+		{
+			for (int i = range.start; i < range.end; i++)
+				Vinv[i] = damped(blocks[i].V, lambda).inv(DECOMP_CHOLESKY);
+		});
+		Mat U = Mat::zeros(nc, nc, CV_64F), reduction = Mat::zeros(nc, nc, CV_64F);
+		rhs = Mat::zeros(nc, 1, CV_64F);
+		for (int i = 0; i < nViews; i++)
+		{
+			Mat WVinv = blocks[i].W * Vinv[i];
+			U += blocks[i].U;
+			reduction += WVinv * blocks[i].W.t();
+			rhs += WVinv * blocks[i].gp - blocks[i].gc;
+		}
+		S = damped(U, lambda) - reduction;
+	};
+
+	double err = linearize();
+	double lambda = 1e-3;
+	const int maxIterations = criteria.type & TermCriteria::COUNT ? criteria.maxCount : 100;
+	const double eps = criteria.type & TermCriteria::EPS ? criteria.epsilon : 0;
+	for (int iter = 0; iter < maxIterations; iter++)
+	{
+		Mat S, rhs, dc;
+		reduce(lambda, S, rhs);
+		if (!solve(S, rhs, dc, DECOMP_CHOLESKY))
+		{
+			lambda *= 10;
+			continue;
+		}
+
+		// back substitution of the poses, then the error at the candidate
+		Intrinsics candidate = intr;
+		candidate.update(dc);
+		Mat K, D;
+		candidate.toMats(K, D);
+		vector<Mat> newR(nViews), newT(nViews);
+		vector<double> errs(nViews);
+		parallel_for_(Range(0, nViews), [&](const Range& range)
+		{
+			for (int i = range.start; i < range.end; i++)
+			{
+				Mat dp = -Vinv[i] * (blocks[i].gp + blocks[i].W.t() * dc);
+				newR[i] = rvecs[i] + dp.rowRange(0, 3);
+				newT[i] = tvecs[i] + dp.rowRange(3, 6);
+				errs[i] = viewError(objectPoints[i], imagePoints[i], K, D, newR[i], newT[i]);
+			}
+		});
+		double newErr = 0;
+		for (double e : errs)
+			newErr += e;
+
+		if (newErr < err)
+		{
+			const bool converged = (err - newErr) <= eps * err;
+			intr = candidate;
+			cameraMatrix = K;
+			distCoeffs = D;
+			rvecs.swap(newR);
+			tvecs.swap(newT);
+			lambda = std::max(lambda / 10, 1e-15);
+			err = linearize();
+			if (converged)
+				break;
+		}
+		else
+		{
+			lambda *= 10;
+			if (lambda > 1e10)
+				break;
+		}
+	}
+
+	// intrinsic covariance: the undamped Schur complement is the information of the intrinsics
+	stdDeviations = Mat::zeros(18, 1, CV_64F);
+	Mat S, rhs;
+	reduce(0, S, rhs);
+	const double dof = std::max(1.0, 2.0 * totalPoints - nc - 6.0 * nViews);
+	Mat covariance = S.inv(DECOMP_SVD) * (err / dof);
+	for (int k = 0; k < nc; k++)
+		stdDeviations.at<double>(intr.active[k]) = std::sqrt(std::max(covariance.at<double>(k, k), 0.0));
+	if (intr.fixAspect)
+		stdDeviations.at<double>(1) = stdDeviations.at<double>(0) * intr.aspect;
+
+	return std::sqrt(err / totalPoints);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Pinhole camera calibration for large numbers of views. The intrinsics are first estimated by
+// calibrateCamera on at most initViews views spread over the set, every view then gets its pose
+// from solvePnP, and all of them are refined together by Levenberg-Marquardt. The normal
+// equations are block-sparse (the poses of two views never interact), so the pose blocks are
+// eliminated with a Schur complement and only the small intrinsic system is solved densely;
+// the cost of an iteration grows linearly with the number of views. Jacobians and the per-view
+// blocks are computed in parallel.
+// flags are the calibrateCamera ones (fixed principal point, aspect ratio, zero tangential
+// distortion, fixed K1..K6, rational model). Outputs match calibrateCamera: 3x1 rvecs/tvecs and
+// the 18x1 intrinsic standard deviations. Returns the RMS reprojection error.
+double calibrateCameraSparse(const vector<vector<Point3f> >& objectPoints,
+	const vector<vector<Point2f> >& imagePoints, Size imageSize, Mat& cameraMatrix, Mat& distCoeffs,
+	vector<Mat>& rvecs, vector<Mat>& tvecs, Mat& stdDeviations, int flags,
+	TermCriteria criteria = TermCriteria(TermCriteria::COUNT + TermCriteria::EPS, 100, 1e-10),
+	int initViews = 40);
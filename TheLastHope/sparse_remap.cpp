@@ -0,0 +1,171 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include "sparse_remap.hpp"
+
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+
+using namespace cv;
+using namespace std;
+
+static const char GRID_MAGIC[4] = { 'S', 'U', 'G', '1' };
+
+void SparseUndistortGrid::build(const CameraCalibration& calib, int step)
+{
+	stepShift = 0;
+	while ((2 << stepShift) <= step && stepShift < 6)
+		stepShift++;
+	const int S = 1 << stepShift;
+
+	imageSize = calib.imageSize;
+	cols = ((imageSize.width - 1) >> stepShift) + 2;
+	rows = ((imageSize.height - 1) >> stepShift) + 2;
+
+	// rays through the grid nodes of the undistorted image, projected back into the distorted one
+	Matx33d P = undistorted_camera_matrix(calib.fisheye, calib.cameraMatrix, calib.distCoeffs, imageSize);
+	vector<Point2f> normalized, src;
+	vector<Point3f> rays;
+	for (int r = 0; r < rows; r++)
+	{
+		for (int c = 0; c < cols; c++)
+		{
+			float x = (float)((c * S - P(0, 2)) / P(0, 0));
+			float y = (float)((r * S - P(1, 2)) / P(1, 1));
+			normalized.push_back(Point2f(x, y));
+			rays.push_back(Point3f(x, y, 1));
+		}
+	}
+	if (calib.fisheye)
+		fisheye::distortPoints(normalized, src, calib.cameraMatrix, calib.distCoeffs);
+	else
+		projectPoints(rays, Vec3d::all(0), Vec3d::all(0), calib.cameraMatrix, calib.distCoeffs, src);
+
+	dx.resize(src.size());
+	dy.resize(src.size());
+	int clipped = 0;
+	for (size_t i = 0; i < src.size(); i++)
+	{
+		double ddx = (src[i].x - (int)(i % cols) * S) * INTER_TAB_SIZE;
+		double ddy = (src[i].y - (int)(i / cols) * S) * INTER_TAB_SIZE;
+		dx[i] = saturate_cast<short>(ddx);
+		dy[i] = saturate_cast<short>(ddy);
+		clipped += dx[i] != cvRound(ddx) || dy[i] != cvRound(ddy);
+	}
+	if (clipped)
+		cerr << clipped << " grid nodes are displaced by more than the fixed point range" << endl;
+}
+
+void SparseUndistortGrid::interpolateRow(int y, short* xy, ushort* frac) const
+{
+	const int S = 1 << stepShift, i = y & (S - 1);
+	const int shift = 2 * stepShift, half = shift ? 1 << (shift - 1) : 0;
+	const short* dx0 = &dx[(y >> stepShift) * cols];
+	const short* dy0 = &dy[(y >> stepShift) * cols];
+	const short* dx1 = dx0 + cols;
+	const short* dy1 = dy0 + cols;
+	const int yFixed = y << INTER_BITS;
+
+	for (int k = 0; (k << stepShift) < imageSize.width; k++)
+	{
+		// the two node columns bounding the cell, interpolated to this row (scaled by S)
+		const int ax0 = (S - i) * dx0[k] + i * dx1[k], ax1 = (S - i) * dx0[k + 1] + i * dx1[k + 1];
+		const int ay0 = (S - i) * dy0[k] + i * dy1[k], ay1 = (S - i) * dy0[k + 1] + i * dy1[k + 1];
+		const int x0 = k << stepShift, n = std::min(S, imageSize.width - x0);
+
+		// plain integer arithmetic over contiguous arrays, which the compiler vectorizes
+		for (int j = 0; j < n; j++)
+		{
+			int X = ((x0 + j) << INTER_BITS) + ((ax0 * (S - j) + ax1 * j + half) >> shift);
+			int Y = yFixed + ((ay0 * (S - j) + ay1 * j + half) >> shift);
+			xy[2 * (x0 + j)] = saturate_cast<short>(X >> INTER_BITS);
+			xy[2 * (x0 + j) + 1] = saturate_cast<short>(Y >> INTER_BITS);
+			frac[x0 + j] = (ushort)((Y & (INTER_TAB_SIZE - 1)) * INTER_TAB_SIZE + (X & (INTER_TAB_SIZE - 1)));
+		}
+	}
+}
+
+void SparseUndistortGrid::remap(const Mat& src, Mat& dst) const
+{
+	CV_Assert(src.size() == imageSize && !dx.empty());
+	dst.create(src.size(), src.type());
+
+	const int S = 1 << stepShift;
+	const int bands = (imageSize.height + S - 1) / S;
+	parallel_for_(Range(0, bands), [&](const Range& range)
+	{
+		Mat xy(S, imageSize.width, CV_16SC2), frac(S, imageSize.width, CV_16UC1);
+		for (int b = range.start; b < range.end; b++)
+		{
+			const int y0 = b * S, n = std::min(S, imageSize.height - y0);
+			for (int i = 0; i < n; i++)
+				interpolateRow(y0 + i, xy.ptr<short>(i), frac.ptr<ushort>(i));
+
+			Mat target = dst.rowRange(y0, y0 + n);
+			cv::remap(src, target, xy.rowRange(0, n), frac.rowRange(0, n), INTER_LINEAR, BORDER_CONSTANT);
+		}
+	});
+}
+
+template<typename T> static void write_pod(ostream& out, const T& value)
+{
+	out.write((const char*)&value, sizeof(T));
+}
+
+template<typename T> static bool read_pod(istream& in, T& value)
+{
+	return (bool)in.read((char*)&value, sizeof(T));
+}
+
+// Layout: magic, image width and height, step shift, node columns and rows, then dx and dy
+bool SparseUndistortGrid::save(const string& fileName) const
+{
+	if (dx.empty())
+		return false;
+	ofstream out(fileName.c_str(), ios::binary | ios::trunc);
+	out.write(GRID_MAGIC, sizeof(GRID_MAGIC));
+	write_pod(out, (int32_t)imageSize.width);
+	write_pod(out, (int32_t)imageSize.height);
+	write_pod(out, (int32_t)stepShift);
+	write_pod(out, (int32_t)cols);
+	write_pod(out, (int32_t)rows);
+	out.write((const char*)&dx[0], dx.size() * sizeof(short));
+	out.write((const char*)&dy[0], dy.size() * sizeof(short));
+	if (!out)
+	{
+		cerr << "Could not write the undistortion grid " << fileName << endl;
+		return false;
+	}
+	return true;
+}
+
+bool SparseUndistortGrid::load(const string& fileName)
+{
+	ifstream in(fileName.c_str(), ios::binary);
+	char magic[sizeof(GRID_MAGIC)];
+	int32_t width, height, shift, c, r;
+	if (!in.read(magic, sizeof(magic)) || !equal(magic, magic + sizeof(magic), GRID_MAGIC) ||
+		!read_pod(in, width) || !read_pod(in, height) || !read_pod(in, shift) || !read_pod(in, c) || !read_pod(in, r) ||
+		width <= 0 || height <= 0 || shift < 0 || shift > 6 ||
+		c != ((width - 1) >> shift) + 2 || r != ((height - 1) >> shift) + 2)
+	{
+		cerr << "Invalid undistortion grid " << fileName << endl;
+		return false;
+	}
+
+	vector<short> gx(c * r), gy(c * r);
+	if (!in.read((char*)&gx[0], gx.size() * sizeof(short)) || !in.read((char*)&gy[0], gy.size() * sizeof(short)))
+	{
+		cerr << "Truncated undistortion grid " << fileName << endl;
+		return false;
+	}
+
+	imageSize = Size(width, height);
+	stepShift = shift;
+	cols = c;
+	rows = r;
+	dx.swap(gx);
+	dy.swap(gy);
+	return true;
+}
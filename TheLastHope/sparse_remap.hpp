@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include "undistortion.hpp"
+
+using namespace cv;
+using namespace std;
+
+// Undistortion for memory constrained targets. Instead of full-resolution maps, only the
+// displacement of every step-th pixel is kept, as int16 fixed point (1/INTER_TAB_SIZE px).
+// At runtime the remap tables are rebuilt one band of rows at a time by integer bilinear
+// interpolation of the grid, so the working set stays a few rows wide.
+class SparseUndistortGrid
+{
+public:
+	SparseUndistortGrid() : stepShift(0), cols(0), rows(0) {}
+
+	// step is rounded down to a power of two, at most 64
+	void build(const CameraCalibration& calib, int step = 8);
+	bool save(const string& fileName) const;
+	bool load(const string& fileName);
+
+	Size size() const { return imageSize; }
+	size_t memoryBytes() const { return (dx.size() + dy.size()) * sizeof(short); }
+
+	// src must have the calibrated image size
+	void remap(const Mat& src, Mat& dst) const;
+
+private:
+	void interpolateRow(int y, short* xy, ushort* frac) const;
+
+	Size imageSize;
+	int stepShift;
+	int cols, rows;          // grid nodes per row and per column
+	vector<short> dx, dy;    // source - destination position of each node
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+using namespace std;
+
+// Lock-free single-producer/single-consumer ring. tryPush is only called from the producer
+// thread and tryPop only from the consumer thread; neither ever blocks. The capacity is
+// rounded up to a power of two.
+template<typename T>
+class SpscRing
+{
+public:
+	explicit SpscRing(size_t capacity) : head(0), tail(0)
+	{
+		size_t n = 1;
+		while (n < capacity)
+			n <<= 1;
+		slots.resize(n);
+		mask = n - 1;
+	}
+
+	bool tryPush(const T& item)
+	{
+		const size_t t = tail.load(memory_order_relaxed);
+		if (t - head.load(memory_order_acquire) > mask)
+			return false;   // full
+		slots[t & mask] = item;
+		tail.store(t + 1, memory_order_release);
+		return true;
+	}
+
+	bool tryPop(T& item)
+	{
+		const size_t h = head.load(memory_order_relaxed);
+		if (h == tail.load(memory_order_acquire))
+			return false;   // empty
+		item = slots[h & mask];
+		head.store(h + 1, memory_order_release);
+		return true;
+	}
+
+private:
+	vector<T> slots;
+	size_t mask;
+	// producer and consumer indices on separate cache lines
+	atomic<size_t> head;
+	char padding[64];
+	atomic<size_t> tail;
+};
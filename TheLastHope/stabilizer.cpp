@@ -0,0 +1,54 @@
+#include <cmath>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+#include "stabilizer.hpp"
+
+using namespace cv;
+using namespace std;
+
+Stabilizer::Stabilizer(int smoothingRadius, double ransacThreshold, size_t maxIters, double confidence)
+	: alpha(smoothingRadius > 0 ? smoothingRadius / (smoothingRadius + 1.) : 0),
+	  ransacThreshold(ransacThreshold), maxIters(maxIters), confidence(confidence), lastInliers(0)
+{
+}
+
+void Stabilizer::reset()
+{
+	trajectory = smoothed = Vec3d();
+	lastInliers = 0;
+}
+
+bool Stabilizer::update(const vector<Point2f>& prevPoints, const vector<Point2f>& points)
+{
+	Vec3d motion;
+	bool estimated = false;
+	lastInliers = 0;
+	if (prevPoints.size() >= 3 && prevPoints.size() == points.size())
+	{
+		vector<uchar> inlierMask;
+		Mat m = estimateAffinePartial2D(prevPoints, points, inlierMask, RANSAC, ransacThreshold, maxIters, confidence);
+		if (!m.empty())
+		{
+			motion = Vec3d(m.at<double>(0, 2), m.at<double>(1, 2), atan2(m.at<double>(1, 0), m.at<double>(0, 0)));
+			lastInliers = countNonZero(inlierMask);
+			estimated = true;
+		}
+	}
+
+	trajectory += motion;
+	smoothed = alpha * smoothed + (1 - alpha) * trajectory;
+	return estimated;
+}
+
+void Stabilizer::stabilize(const Mat& frame, Mat& stabilized, double zoom) const
+{
+	// the correction is a rotation about the origin plus a shift, like the motions
+	// estimateAffinePartial2D gave update(); the zoom is then applied about the image centre
+	const Vec3d correction = smoothed - trajectory;
+	const double c = cos(correction[2]), s = sin(correction[2]);
+	const double cx = frame.cols / 2., cy = frame.rows / 2.;
+	Mat m = (Mat_<double>(2, 3) <<
+		zoom * c, -zoom * s, zoom * correction[0] + (1 - zoom) * cx,
+		zoom * s, zoom * c, zoom * correction[1] + (1 - zoom) * cy);
+	warpAffine(frame, stabilized, m, frame.size(), INTER_LINEAR, BORDER_CONSTANT);
+}
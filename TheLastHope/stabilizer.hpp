@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Online video stabilization from tracked features. Each frame the motion from the previous
+// frame is estimated as a similarity (estimateAffinePartial2D with RANSAC, bounded iterations and
+// early exit at the given confidence) and accumulated into the camera trajectory (x, y, angle).
+// The trajectory is smoothed causally (exponential average over about smoothingRadius frames),
+// and the frame is moved from the real to the smoothed trajectory with a single warpAffine.
+class Stabilizer
+{
+public:
+	Stabilizer(int smoothingRadius = 30, double ransacThreshold = 3, size_t maxIters = 200, double confidence = 0.99);
+
+	// prevPoints[i] in the previous frame matches points[i] in this one. Returns false if no
+	// motion could be estimated, in which case the camera is assumed still.
+	bool update(const vector<Point2f>& prevPoints, const vector<Point2f>& points);
+
+	// The current frame moved onto the smoothed trajectory. zoom > 1 hides the borders
+	// uncovered by the correction.
+	void stabilize(const Mat& frame, Mat& stabilized, double zoom = 1) const;
+
+	void reset();
+
+	int inliers() const { return lastInliers; }
+
+private:
+	Vec3d trajectory;   // accumulated x, y, angle (radians)
+	Vec3d smoothed;
+	double alpha;
+	double ransacThreshold;
+	size_t maxIters;
+	double confidence;
+	int lastInliers;
+};
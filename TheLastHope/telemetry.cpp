@@ -0,0 +1,165 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include "telemetry.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+using namespace std;
+
+static const char TELEMETRY_MAGIC[4] = { 'P', 'T', 'L', '1' };
+
+int64_t TelemetryPublisher::nowUs()
+{
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TelemetryPublisher::TelemetryPublisher(const string& destination, size_t capacity)
+	: ring(capacity), stopping(false), droppedRecords(0), opened(false), file(NULL), listenFd(-1)
+{
+	if (destination.compare(0, 5, "unix:") == 0)
+		opened = openSocket(destination.substr(5));
+	else
+		opened = openFile(destination);
+
+	if (opened)
+		writer = thread(&TelemetryPublisher::run, this);
+}
+
+TelemetryPublisher::~TelemetryPublisher()
+{
+	stopping = true;
+	if (writer.joinable())
+		writer.join();
+	if (file)
+		fclose(file);
+#ifndef _WIN32
+	for (int fd : clients)
+		close(fd);
+	if (listenFd >= 0)
+	{
+		close(listenFd);
+		unlink(socketPath.c_str());
+	}
+#endif
+}
+
+void TelemetryPublisher::publish(const PoseTelemetry& record)
+{
+	if (opened && !ring.tryPush(record))
+		droppedRecords++;
+}
+
+bool TelemetryPublisher::openFile(const string& path)
+{
+	file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		cerr << "Could not open the telemetry log " << path << endl;
+		return false;
+	}
+	const uint32_t recordSize = sizeof(PoseTelemetry);
+	fwrite(TELEMETRY_MAGIC, 1, sizeof(TELEMETRY_MAGIC), file);
+	fwrite(&recordSize, sizeof(recordSize), 1, file);
+	return true;
+}
+
+bool TelemetryPublisher::openSocket(const string& path)
+{
+#ifdef _WIN32
+	cerr << "UNIX socket telemetry is not supported on this platform, use a log file" << endl;
+	return false;
+#else
+	sockaddr_un addr;
+	if (path.size() >= sizeof(addr.sun_path))
+	{
+		cerr << "Telemetry socket path too long: " << path << endl;
+		return false;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path.c_str());
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(path.c_str());
+	if (listenFd < 0 || bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 4) != 0)
+	{
+		cerr << "Could not listen on the telemetry socket " << path << ": " << strerror(errno) << endl;
+		return false;
+	}
+	fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+	socketPath = path;
+	return true;
+#endif
+}
+
+void TelemetryPublisher::acceptClients()
+{
+#ifndef _WIN32
+	for (int fd; (fd = accept(listenFd, NULL, NULL)) >= 0; )
+	{
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+		const uint32_t recordSize = sizeof(PoseTelemetry);
+		char header[sizeof(TELEMETRY_MAGIC) + sizeof(recordSize)];
+		memcpy(header, TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC));
+		memcpy(header + sizeof(TELEMETRY_MAGIC), &recordSize, sizeof(recordSize));
+		if (send(fd, header, sizeof(header), MSG_NOSIGNAL) == (ssize_t)sizeof(header))
+			clients.push_back(fd);
+		else
+			close(fd);
+	}
+#endif
+}
+
+void TelemetryPublisher::write(const PoseTelemetry& record)
+{
+	if (file)
+	{
+		fwrite(&record, sizeof(record), 1, file);
+		return;
+	}
+#ifndef _WIN32
+	// a client that cannot keep up is disconnected rather than waited for
+	for (size_t i = 0; i < clients.size(); )
+	{
+		if (send(clients[i], &record, sizeof(record), MSG_NOSIGNAL | MSG_DONTWAIT) == (ssize_t)sizeof(record))
+			i++;
+		else
+		{
+			close(clients[i]);
+			clients.erase(clients.begin() + i);
+		}
+	}
+#endif
+}
+
+void TelemetryPublisher::run()
+{
+	PoseTelemetry record;
+	for (;;)
+	{
+		if (listenFd >= 0)
+			acceptClients();
+
+		bool any = false;
+		while (ring.tryPop(record))
+		{
+			write(record);
+			any = true;
+		}
+		if (any && file)
+			fflush(file);
+
+		if (stopping && !any)
+			break;
+		if (!any)
+			this_thread::sleep_for(chrono::milliseconds(1));
+	}
+}
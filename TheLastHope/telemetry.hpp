@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#include "spsc_ring.hpp"
+
+using namespace std;
+
+// One record per processed frame of the pose loop, written as-is (little endian, no padding
+// between fields of equal alignment) after a "PTL1" + record size header.
+struct PoseTelemetry
+{
+	int64_t timestampUs;     // steady clock
+	uint64_t frame;
+	int32_t found;           // 1 when the board was detected and the pose solved, 2 for a predicted pose
+	int32_t reserved;
+	double euler[3];         // roll, pitch, yaw in radians
+	double translation[3];   // board origin in the camera frame, board units
+	double rmse;             // reprojection RMSE in pixels
+};
+
+// Publishes pose telemetry without ever blocking the vision loop: publish() only pushes into
+// a lock-free ring (dropping the record if the ring is full), and a writer thread drains the
+// ring to a binary log file or to the clients of a local UNIX socket ("unix:/path").
+class TelemetryPublisher
+{
+public:
+	TelemetryPublisher(const string& destination, size_t capacity = 1024);
+	~TelemetryPublisher();
+
+	bool isOpen() const { return opened; }
+	void publish(const PoseTelemetry& record);
+	uint64_t dropped() const { return droppedRecords.load(); }
+
+	static int64_t nowUs();
+
+private:
+	void run();
+	bool openFile(const string& path);
+	bool openSocket(const string& path);
+	void write(const PoseTelemetry& record);
+	void acceptClients();
+
+	SpscRing<PoseTelemetry> ring;
+	atomic<bool> stopping;
+	atomic<uint64_t> droppedRecords;
+	bool opened;
+	FILE* file;
+	int listenFd;
+	vector<int> clients;
+	string socketPath;
+	thread writer;
+};
@@ -0,0 +1,427 @@
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <map>
+#include <functional>
+#include <algorithm>
+#include <cctype>
+#include "undistortion.hpp"
+#include "bounded_queue.hpp"
+#include "sparse_remap.hpp"
+
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+
+using namespace cv;
+using namespace std;
+
+bool load_calibration(const string& fileName, CameraCalibration& calib)
+{
+	FileStorage fs;
+	if (!fs.open(fileName, FileStorage::READ))
+	{
+		cerr << "Could not open the calibration file " << fileName << endl;
+		return false;
+	}
+
+	// name every missing key instead of silently reading empty matrices
+	static const char* required[] = { "image_width", "image_height", "camera_matrix", "distortion_coefficients" };
+	bool complete = true;
+	for (const char* key : required)
+	{
+		if (fs[key].empty())
+		{
+			cerr << "Calibration file " << fileName << " has no key \"" << key << "\"";
+			if (!string(key).compare("distortion_coefficients") && !fs["distorsion_coefficients"].empty())
+				cerr << " (it has the misspelled \"distorsion_coefficients\")";
+			cerr << endl;
+			complete = false;
+		}
+	}
+	if (!complete)
+		return false;
+
+	int fisheye = 0;
+	fs["image_width"] >> calib.imageSize.width;
+	fs["image_height"] >> calib.imageSize.height;
+	fs["camera_matrix"] >> calib.cameraMatrix;
+	fs["distortion_coefficients"] >> calib.distCoeffs;
+	fs["fisheye_model"] >> fisheye;
+	calib.fisheye = fisheye != 0;
+
+	if (calib.cameraMatrix.size() != Size(3, 3) || calib.distCoeffs.empty() || calib.imageSize.area() <= 0 ||
+		!checkRange(calib.cameraMatrix) || !checkRange(calib.distCoeffs))
+	{
+		cerr << "Incomplete calibration in " << fileName << endl;
+		return false;
+	}
+	return true;
+}
+
+Mat undistorted_camera_matrix(bool useFisheye, const Mat& cameraMatrix, const Mat& distCoeffs, Size size)
+{
+	if (useFisheye)
+	{
+		Mat newCamMat;
+		fisheye::estimateNewCameraMatrixForUndistortRectify(cameraMatrix, distCoeffs, size,
+			Matx33d::eye(), newCamMat, 1);
+		return newCamMat;
+	}
+	return getOptimalNewCameraMatrix(cameraMatrix, distCoeffs, size, 1, size, 0);
+}
+
+// Camera matrix of views of viewSize decoded from frames of the calibrated imageSize
+static Matx33d view_camera_matrix(const Mat& cameraMatrix, Size imageSize, Size viewSize)
+{
+	Matx33d K = cameraMatrix;
+	const double sx = (double)viewSize.width / imageSize.width, sy = (double)viewSize.height / imageSize.height;
+	K(0, 0) *= sx; K(0, 1) *= sx; K(0, 2) *= sx;
+	K(1, 1) *= sy; K(1, 2) *= sy;
+	return K;
+}
+
+void buildUndistortMaps(bool useFisheye, const Mat& cameraMatrix, const Mat& distCoeffs, Size imageSize,
+	Size viewSize, Mat& map1, Mat& map2)
+{
+	Matx33d K = view_camera_matrix(cameraMatrix, imageSize, viewSize);
+	Mat newCamMat = undistorted_camera_matrix(useFisheye, Mat(K), distCoeffs, viewSize);
+	if (useFisheye)
+		fisheye::initUndistortRectifyMap(K, distCoeffs, Matx33d::eye(), newCamMat, viewSize,
+			CV_16SC2, map1, map2);
+	else
+		initUndistortRectifyMap(K, distCoeffs, Mat(), newCamMat, viewSize, CV_16SC2, map1, map2);
+}
+
+ViewUndistorter::ViewUndistorter(bool useFisheye, const Mat& cameraMatrix, const Mat& distCoeffs, Size imageSize,
+	Size viewSize)
+	: useFisheye(useFisheye), cameraMatrix(cameraMatrix.clone()), distCoeffs(distCoeffs.clone()), size(viewSize)
+{
+	viewCameraMatrix = Mat(view_camera_matrix(cameraMatrix, imageSize, viewSize));
+	newCameraMatrix = undistorted_camera_matrix(useFisheye, viewCameraMatrix, distCoeffs, viewSize);
+	buildUndistortMaps(useFisheye, cameraMatrix, distCoeffs, imageSize, viewSize, map1, map2);
+}
+
+bool ViewUndistorter::fits(bool useFisheye, const Mat& cameraMatrix, const Mat& distCoeffs, Size viewSize) const
+{
+	return useFisheye == this->useFisheye && viewSize == size &&
+		cameraMatrix.size() == this->cameraMatrix.size() && distCoeffs.size() == this->distCoeffs.size() &&
+		norm(cameraMatrix, this->cameraMatrix, NORM_INF) == 0 && norm(distCoeffs, this->distCoeffs, NORM_INF) == 0;
+}
+
+void ViewUndistorter::undistort(const Mat& view, Mat& dst) const
+{
+	remap(view, dst, map1, map2, INTER_LINEAR);
+}
+
+void ViewUndistorter::undistortPoints(const vector<Point2f>& points, vector<Point2f>& undistorted) const
+{
+	// points may be undistorted itself
+	vector<Point2f> moved;
+	if (useFisheye && !points.empty())
+		fisheye::undistortPoints(points, moved, viewCameraMatrix, distCoeffs, noArray(), newCameraMatrix);
+	else if (!points.empty())
+		cv::undistortPoints(points, moved, viewCameraMatrix, distCoeffs, noArray(), newCameraMatrix);
+	undistorted.swap(moved);
+}
+
+RoiUndistorter::RoiUndistorter(const Mat& cameraMatrix, const Mat& distCoeffs, Size imageSize, size_t maxCached)
+	: cameraMatrix(cameraMatrix), distCoeffs(distCoeffs), imageSize(imageSize), maxCached(std::max(maxCached, (size_t)1))
+{
+}
+
+// Moves the tables of roi to the front of the cache, building them if needed
+const RoiUndistorter::RegionMaps& RoiUndistorter::regionMaps(Rect roi)
+{
+	size_t i = 0;
+	while (i < cached.size() && cached[i].roi != roi)
+		i++;
+	if (i == cached.size())
+	{
+		RegionMaps region;
+		region.roi = roi;
+		Matx33d P = cameraMatrix;
+		P(0, 2) -= roi.x;
+		P(1, 2) -= roi.y;
+		initUndistortRectifyMap(cameraMatrix, distCoeffs, Mat(), P, roi.size(), CV_16SC2, region.map1, region.map2);
+		if (cached.size() >= maxCached)
+			cached.pop_back();
+		cached.insert(cached.begin(), region);
+	}
+	else if (i > 0)
+		rotate(cached.begin(), cached.begin() + i, cached.begin() + i + 1);
+	return cached[0];
+}
+
+void RoiUndistorter::prepare(Rect roi)
+{
+	roi &= Rect(Point(0, 0), imageSize);
+	if (!roi.empty())
+		regionMaps(roi);
+}
+
+void RoiUndistorter::undistort(const Mat& view, Mat& dst, Rect roi)
+{
+	roi &= Rect(Point(0, 0), view.size());
+	if (view.empty() || roi.empty())
+		return;
+
+	const RegionMaps& maps = regionMaps(roi);
+	Mat target = dst(roi);
+	remap(view, target, maps.map1, maps.map2, INTER_LINEAR);
+}
+
+Rect RoiUndistorter::boardRegion(const vector<Point2f>& imagePoints, int margin, int align) const
+{
+	Rect frame(Point(0, 0), imageSize);
+	if (imagePoints.empty())
+		return frame;
+
+	vector<Point2f> undistorted;
+	undistortPoints(imagePoints, undistorted, cameraMatrix, distCoeffs, noArray(), cameraMatrix);
+	Rect box = boundingRect(undistorted);
+
+	int x0 = (std::max(box.x - margin, 0) / align) * align;
+	int y0 = (std::max(box.y - margin, 0) / align) * align;
+	int x1 = ((box.x + box.width + margin + align - 1) / align) * align;
+	int y1 = ((box.y + box.height + margin + align - 1) / align) * align;
+	return Rect(x0, y0, x1 - x0, y1 - y0) & frame;
+}
+
+static bool is_image_file(const string& path)
+{
+	static const char* extensions[] = { ".png", ".jpg", ".jpeg", ".bmp", ".tif", ".tiff", ".webp", ".pgm", ".ppm" };
+	size_t dot = path.find_last_of('.');
+	if (dot == string::npos)
+		return false;
+	string ext = path.substr(dot);
+	transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	for (const char* e : extensions)
+		if (ext == e)
+			return true;
+	return false;
+}
+
+static string file_name(const string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+// Maps for a frame size, built on first use; every worker shares them read-only afterwards
+class MapCache
+{
+public:
+	explicit MapCache(const CameraCalibration& calib) : calib(calib) {}
+
+	void get(Size size, Mat& map1, Mat& map2)
+	{
+		unique_lock<mutex> guard(lock);
+		pair<Mat, Mat>& maps = bySize[make_pair(size.width, size.height)];
+		if (maps.first.empty())
+			buildUndistortMaps(calib.fisheye, calib.cameraMatrix, calib.distCoeffs, calib.imageSize, size,
+				maps.first, maps.second);
+		map1 = maps.first;
+		map2 = maps.second;
+	}
+
+private:
+	const CameraCalibration& calib;
+	map<pair<int, int>, pair<Mat, Mat> > bySize;
+	mutex lock;
+};
+
+// Images are independent: each worker decodes, remaps and encodes its own share of the list
+typedef function<void(const Mat&, Mat&)> FrameUndistorter;
+
+static int undistort_images(const FrameUndistorter& undistort_frame, const vector<string>& files,
+	const string& output, int threads)
+{
+	if (!utils::fs::exists(output))
+		utils::fs::createDirectories(output);
+
+	atomic<size_t> next(0), written(0);
+	vector<thread> workers;
+	for (int t = 0; t < threads; t++)
+	{
+		workers.push_back(thread([&] {
+			Mat rview;
+			for (size_t i = next++; i < files.size(); i = next++)
+			{
+				Mat view = imread(files[i], IMREAD_UNCHANGED);
+				if (view.empty())
+				{
+					cerr << "Could not read " << files[i] << endl;
+					continue;
+				}
+				undistort_frame(view, rview);
+				if (rview.empty())
+				{
+					cerr << "Skipping " << files[i] << ": " << view.cols << "x" << view.rows
+					     << " does not match the undistortion grid" << endl;
+					continue;
+				}
+				if (imwrite(output + "/" + file_name(files[i]), rview))
+					written++;
+			}
+		}));
+	}
+	for (thread& w : workers)
+		w.join();
+
+	cout << "Undistorted " << written << "/" << files.size() << " images into " << output << endl;
+	return written == files.size() ? 0 : -1;
+}
+
+struct Frame
+{
+	int64 seq;
+	Mat image;
+};
+
+// Video frames are decoded and encoded in order by one thread each, remapped by the workers
+// in between. The writer puts the frames back in sequence before encoding.
+static int undistort_video(const FrameUndistorter& undistort_frame, const string& input, const string& output,
+	int threads)
+{
+	VideoCapture capture(input);
+	if (!capture.isOpened())
+	{
+		cerr << "Could not open the video " << input << endl;
+		return -1;
+	}
+	Size frameSize((int)capture.get(CAP_PROP_FRAME_WIDTH), (int)capture.get(CAP_PROP_FRAME_HEIGHT));
+	double fps = capture.get(CAP_PROP_FPS);
+	int fourcc = (int)capture.get(CAP_PROP_FOURCC);
+	if (fourcc == 0)
+		fourcc = VideoWriter::fourcc('m', 'p', '4', 'v');
+
+	VideoWriter writer(output, fourcc, fps > 0 ? fps : 30, frameSize);
+	if (!writer.isOpened())
+	{
+		cerr << "Could not open the output video " << output << endl;
+		return -1;
+	}
+
+	BoundedQueue<Frame> decoded(2 * threads), remapped(2 * threads);
+
+	thread reader([&] {
+		Frame f;
+		for (f.seq = 0; capture.read(f.image); f.seq++)
+		{
+			if (!decoded.push(f))
+				break;
+			f.image = Mat();
+		}
+		decoded.close();
+	});
+
+	atomic<int> running(threads);
+	vector<thread> workers;
+	for (int t = 0; t < threads; t++)
+	{
+		workers.push_back(thread([&] {
+			Frame in;
+			while (decoded.pop(in))
+			{
+				Frame out;
+				out.seq = in.seq;
+				undistort_frame(in.image, out.image);
+				remapped.push(out);
+			}
+			if (--running == 0)
+				remapped.close();
+		}));
+	}
+
+	map<int64, Mat> pending;
+	int64 nextSeq = 0;
+	Frame f;
+	while (remapped.pop(f))
+	{
+		pending[f.seq] = f.image;
+		for (auto it = pending.find(nextSeq); it != pending.end(); it = pending.find(++nextSeq))
+		{
+			if (it->second.empty())
+				cerr << "Skipping frame " << it->first << ": its size does not match the undistortion grid" << endl;
+			else
+				writer.write(it->second);
+			pending.erase(it);
+		}
+	}
+
+	reader.join();
+	for (thread& w : workers)
+		w.join();
+
+	cout << "Undistorted " << nextSeq << " frames into " << output << endl;
+	return 0;
+}
+
+int run_batch_undistort(const string& calibFile, const string& input, const string& output, int threads,
+	int gridStep, const string& gridFile)
+{
+	CameraCalibration calib;
+	SparseUndistortGrid grid;
+	bool useGrid = gridStep > 0 || !gridFile.empty();
+
+	if (useGrid && !gridFile.empty() && utils::fs::exists(gridFile))
+	{
+		// deployment: the grid file replaces the calibration
+		if (!grid.load(gridFile))
+			return -1;
+	}
+	else
+	{
+		if (!load_calibration(calibFile, calib))
+			return -1;
+		if (useGrid)
+		{
+			grid.build(calib, gridStep > 0 ? gridStep : 8);
+			if (!gridFile.empty() && !grid.save(gridFile))
+				return -1;
+		}
+	}
+	if (useGrid)
+		cout << "Sparse undistortion grid: " << grid.memoryBytes() / 1024 << " KB" << endl;
+
+	if (threads <= 0)
+		threads = std::max(getNumberOfCPUs(), 1);
+
+	// the workers already keep every core busy
+	setNumThreads(0);
+
+	MapCache maps(calib);
+	FrameUndistorter undistort_frame;
+	if (useGrid)
+		undistort_frame = [&grid](const Mat& view, Mat& rview) {
+			// the grid only fits the calibrated frame size; other frames are skipped (empty output)
+			if (view.size() != grid.size())
+			{
+				rview.release();
+				return;
+			}
+			grid.remap(view, rview);
+		};
+	else
+		undistort_frame = [&maps](const Mat& view, Mat& rview) {
+			Mat map1, map2;
+			maps.get(view.size(), map1, map2);
+			remap(view, rview, map1, map2, INTER_LINEAR);
+		};
+
+	if (utils::fs::isDirectory(input))
+	{
+		vector<String> all;
+		glob(input, all, false);
+		vector<string> files;
+		for (const String& f : all)
+			if (is_image_file(f))
+				files.push_back(f);
+		return undistort_images(undistort_frame, files, output, threads);
+	}
+	return undistort_video(undistort_frame, input, output, threads);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+using namespace cv;
+using namespace std;
+
+// Intrinsics as written by saveCameraParams
+struct CameraCalibration
+{
+	Size imageSize;
+	Mat cameraMatrix;
+	Mat distCoeffs;
+	bool fisheye;
+};
+
+bool load_calibration(const string& fileName, CameraCalibration& calib);
+
+// Camera matrix of the undistorted views: all source pixels kept (alpha / balance = 1)
+Mat undistorted_camera_matrix(bool useFisheye, const Mat& cameraMatrix, const Mat& distCoeffs, Size size);
+
+// Undistortion maps for views of viewSize, which may be a reduced decode of the calibrated imageSize
+void buildUndistortMaps(bool useFisheye, const Mat& cameraMatrix, const Mat& distCoeffs, Size imageSize,
+	Size viewSize, Mat& map1, Mat& map2);
+
+// Full-frame undistortion with the maps of one calibration, built once. const and safe to
+// share between threads; the points of a view can be moved into the undistorted frame alike.
+class ViewUndistorter
+{
+public:
+	ViewUndistorter(bool useFisheye, const Mat& cameraMatrix, const Mat& distCoeffs, Size imageSize, Size viewSize);
+
+	// Built for this calibration and views of viewSize
+	bool fits(bool useFisheye, const Mat& cameraMatrix, const Mat& distCoeffs, Size viewSize) const;
+	Size viewSize() const { return size; }
+
+	void undistort(const Mat& view, Mat& dst) const;
+	void undistortPoints(const vector<Point2f>& points, vector<Point2f>& undistorted) const;
+
+private:
+	bool useFisheye;
+	Mat cameraMatrix, distCoeffs;   // as calibrated
+	Mat viewCameraMatrix;           // scaled to the views
+	Mat newCameraMatrix;            // of the undistorted views
+	Size size;
+	Mat map1, map2;
+};
+
+// Pinhole undistortion of regions of interest only. The remap tables of a region are built for
+// that region alone (the new camera matrix is shifted by its offset) and cached, so the output
+// keeps the full-frame undistorted pixel coordinates while only the region's pixels are remapped.
+class RoiUndistorter
+{
+public:
+	RoiUndistorter(const Mat& cameraMatrix, const Mat& distCoeffs, Size imageSize, size_t maxCached = 8);
+
+	// Writes the undistorted content of roi into dst, which must be an image of the frame size
+	void undistort(const Mat& view, Mat& dst, Rect roi);
+
+	// Builds the tables of roi ahead of the first frame that needs them
+	void prepare(Rect roi);
+
+	// Bounding region of the detected board in the undistorted frame, grown by margin and
+	// aligned to `align` pixels so that small board motions reuse the cached tables
+	Rect boardRegion(const vector<Point2f>& imagePoints, int margin, int align = 32) const;
+
+private:
+	struct RegionMaps
+	{
+		Rect roi;
+		Mat map1, map2;
+	};
+
+	const RegionMaps& regionMaps(Rect roi);
+
+	Mat cameraMatrix, distCoeffs;
+	Size imageSize;
+	size_t maxCached;
+	vector<RegionMaps> cached;   // most recently used first
+};
+
+// Undistorts every image of a directory, or every frame of a video, with a saved calibration.
+// The maps are built once; decode, remap and encode run on `threads` worker threads.
+// output is a directory for images and a video file name for videos.
+// With gridStep > 0 or a gridFile, a SparseUndistortGrid replaces the full-size maps: it is
+// loaded from gridFile when that exists, otherwise built from the calibration (and saved there).
+int run_batch_undistort(const string& calibFile, const string& input, const string& output, int threads,
+	int gridStep = 0, const string& gridFile = string());
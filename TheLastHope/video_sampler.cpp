@@ -0,0 +1,117 @@
+#include <iostream>
+#include <algorithm>
+#include "video_sampler.hpp"
+
+using namespace cv;
+using namespace std;
+
+VideoSampler::VideoSampler(const string& fileName, int stride, int candidates, int segments,
+	int seekThreshold, size_t depth)
+	: fileName(fileName), stride(std::max(stride, 1)), seekThreshold(std::max(seekThreshold, 1)),
+	  opened(false), cursor(0)
+{
+	VideoCapture probe(fileName);
+	if (!probe.isOpened())
+		return;
+	opened = true;
+	const int frameCount = (int)probe.get(CAP_PROP_FRAME_COUNT);
+	probe.release();
+
+	vector<int> sample;
+	if (frameCount > 0)
+	{
+		if (candidates > 0)
+		{
+			// the middle of `candidates` equal parts of the video
+			const int n = std::min(candidates, frameCount);
+			for (int k = 0; k < n; k++)
+				sample.push_back((int)(((int64)2 * k + 1) * frameCount / (2 * n)));
+		}
+		else
+			for (int i = 0; i < frameCount; i += this->stride)
+				sample.push_back(i);
+	}
+
+	const size_t parts = sample.empty() ? 1 : std::min((size_t)std::max(segments, 1), sample.size());
+	indices.resize(parts);
+	for (size_t p = 0; p < parts && !sample.empty(); p++)
+		indices[p].assign(sample.begin() + sample.size() * p / parts, sample.begin() + sample.size() * (p + 1) / parts);
+
+	finished.assign(parts, false);
+	for (size_t p = 0; p < parts; p++)
+		queues.push_back(makePtr<BoundedQueue<Mat> >(std::max(depth, (size_t)1)));
+	for (size_t p = 0; p < parts; p++)
+		workers.push_back(thread(&VideoSampler::run, this, p));
+}
+
+VideoSampler::~VideoSampler()
+{
+	for (Ptr<BoundedQueue<Mat> >& q : queues)
+		q->close();
+	for (thread& t : workers)
+		t.join();
+}
+
+void VideoSampler::run(size_t segment)
+{
+	BoundedQueue<Mat>& queue = *queues[segment];
+	VideoCapture capture(fileName);
+	if (!capture.isOpened())
+	{
+		cerr << "Could not open " << fileName << " for sampling" << endl;
+		queue.close();
+		return;
+	}
+
+	if (indices[segment].empty())
+	{
+		// unknown length: read one frame, grab the next stride - 1
+		for (;;)
+		{
+			Mat frame;    // a new buffer each time, the queued frames keep theirs
+			if (!capture.read(frame) || !queue.push(frame))
+				break;
+			for (int i = 1; i < stride; i++)
+				if (!capture.grab())
+					break;
+		}
+		queue.close();
+		return;
+	}
+
+	int position = 0;
+	for (int index : indices[segment])
+	{
+		if (index - position > seekThreshold || index < position)
+		{
+			capture.set(CAP_PROP_POS_FRAMES, index);
+			position = index;
+		}
+		bool ok = true;
+		for (; position < index && ok; position++)
+			ok = capture.grab();
+		Mat frame;
+		if (!ok || !capture.read(frame))
+			break;
+		position++;
+		if (!queue.push(frame))
+			break;
+	}
+	queue.close();
+}
+
+Mat VideoSampler::next()
+{
+	Mat frame;
+	for (size_t tries = 0; tries < queues.size(); tries++)
+	{
+		const size_t p = cursor;
+		cursor = (cursor + 1) % queues.size();
+		if (finished[p])
+			continue;
+		if (queues[p]->pop(frame))
+			return frame;
+		finished[p] = true;
+	}
+	return Mat();
+}
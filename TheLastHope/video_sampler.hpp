@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "bounded_queue.hpp"
+
+using namespace cv;
+using namespace std;
+
+// Samples the frames of a video file instead of decoding all of them: every stride-th frame,
+// or `candidates` frames spread evenly over the whole video. Skipped frames are only grab()bed,
+// and gaps longer than seekThreshold frames are crossed by seeking (to the nearest keyframe in
+// most backends). The video is split into `segments` contiguous parts, each decoded by its own
+// thread and VideoCapture; next() takes one frame from each part in turn, so any prefix of the
+// sample already spans the whole video. Videos of unknown length are read by one thread.
+class VideoSampler
+{
+public:
+	VideoSampler(const string& fileName, int stride, int candidates = 0, int segments = 1,
+		int seekThreshold = 100, size_t depth = 4);
+	~VideoSampler();
+
+	bool isOpen() const { return opened; }
+	// Next sampled frame; empty once every part is exhausted
+	Mat next();
+
+private:
+	void run(size_t segment);
+
+	string fileName;
+	int stride;
+	int seekThreshold;
+	bool opened;
+	vector<vector<int> > indices;    // frames of each part, empty = every stride-th until the end
+	vector<Ptr<BoundedQueue<Mat> > > queues;
+	vector<bool> finished;
+	size_t cursor;
+	vector<thread> workers;
+};